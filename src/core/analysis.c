@@ -0,0 +1,412 @@
+/**
+ * Copyright 2022 TotalJustice.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vb.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef VB_THREADS
+  #include <pthread.h>
+  #include <stdatomic.h>
+#endif
+
+
+/*
+[some notes]
+
+- the rom is walked from the reset and interrupt / exception vectors,
+  following every branch whose target can be worked out. that's the
+  pc-relative ones (Bcond, JR, JAL), and JMP to a register that was set
+  to a constant in the same block (movhi + movea + jmp is how the reset
+  vector gets into the rom proper). JMP [lp] is a return, so that's where
+  a walk ends, the same as anywhere the target isn't known.
+
+- it only ever reads the rom, and everything it finds goes into its own
+  tables, so it can run on a thread while the cpu is running. the cpu
+  takes what it found the next time vb_run_cycles() is called after it
+  has finished, see vb_analysis_apply().
+
+- what it decodes is laid out the same as vb->predecode, so the cpu
+  copies whatever it hasn't already decoded itself, then builds the
+  blocks that start at each block start.
+*/
+
+enum {
+  MARK_CODE = 1 << 0, // an instruction starts here
+  MARK_BLOCK = 1 << 1, // a basic block starts here
+  MARK_FUNCTION = 1 << 2, // a vector or the target of a jal
+
+  // Bcond conditions that don't need the flags.
+  COND_ALWAYS = 0x5,
+  COND_NEVER = 0xD,
+
+  REG_LP = 31,
+};
+
+// where the cpu starts for reset, interrupts and exceptions.
+static const uint32_t VECTORS[] = {
+  0xFFFFFFF0, // reset
+  0xFFFFFE00, 0xFFFFFE10, 0xFFFFFE20, 0xFFFFFE30, 0xFFFFFE40, // interrupts
+  0xFFFFFF60, // float
+  0xFFFFFF80, // divide by zero
+  0xFFFFFF90, // invalid opcode
+  0xFFFFFFA0, 0xFFFFFFB0, // trap
+  0xFFFFFFC0, // address trap
+  0xFFFFFFD0, // duplexed exception
+};
+
+struct AddrList {
+  uint32_t* data;
+  size_t count;
+  size_t capacity;
+  bool failed;
+};
+
+struct VB_Analysis {
+  const uint8_t* rom;
+  uint32_t rom_mask;
+
+  // MARK_* for each halfword of the rom.
+  uint8_t* marks;
+  // same layout as vb->predecode.
+  struct VB_DecodedOp* ops;
+
+  struct AddrList blocks;
+  struct AddrList functions;
+  struct AddrList pending; // block starts still to be walked
+
+  #ifdef VB_THREADS
+    pthread_t thread;
+    bool threaded;
+    atomic_bool done;
+  #else
+    bool done;
+  #endif
+};
+
+static void list_push(struct AddrList* list, uint32_t addr) {
+  if (list->count == list->capacity) {
+    const size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+    uint32_t* data = realloc(list->data, capacity * sizeof(*data));
+
+    if (!data) {
+      list->failed = true;
+      return;
+    }
+
+    list->data = data;
+    list->capacity = capacity;
+  }
+
+  list->data[list->count++] = addr;
+}
+
+static int addr_compare(const void* a, const void* b) {
+  const uint32_t x = *(const uint32_t*)a;
+  const uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+static inline bool is_rom(uint32_t addr) {
+  return ((addr >> 24) & 0x7) == 0x7;
+}
+
+static inline bool is_store(uint8_t opcode) {
+  switch (opcode) {
+    case 0x34: case 0x35: case 0x37: // ST
+    case 0x3C: case 0x3D: case 0x3F: // OUT
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static inline uint16_t rom_read_16(const struct VB_Analysis* a, uint32_t addr) {
+  uint16_t value;
+  memcpy(&value, a->rom + (addr & a->rom_mask & ~1), sizeof(value));
+  return value;
+}
+
+static inline uint8_t* mark_at(struct VB_Analysis* a, uint32_t addr) {
+  return &a->marks[(addr & a->rom_mask) >> 1];
+}
+
+static void add_block(struct VB_Analysis* a, uint32_t addr) {
+  addr &= ~1;
+
+  if (is_rom(addr) && !(*mark_at(a, addr) & MARK_BLOCK)) {
+    *mark_at(a, addr) |= MARK_BLOCK;
+    list_push(&a->blocks, addr);
+    list_push(&a->pending, addr);
+  }
+}
+
+static void add_function(struct VB_Analysis* a, uint32_t addr) {
+  addr &= ~1;
+
+  if (is_rom(addr) && !(*mark_at(a, addr) & MARK_FUNCTION)) {
+    *mark_at(a, addr) |= MARK_FUNCTION;
+    list_push(&a->functions, addr);
+  }
+
+  add_block(a, addr);
+}
+
+// decodes into a->ops, the same way fetch() in v810.c fills vb->predecode.
+static void decode_at(struct VB_Analysis* a, uint32_t addr, struct VB_DecodedOp* op) {
+  const uint32_t offset = addr & a->rom_mask;
+  struct VB_DecodedOp* slot = &a->ops[(offset >> 1) & (VB_PREDECODE_ENTRIES - 1)];
+
+  vb_v810_decode(op, rom_read_16(a, addr), rom_read_16(a, addr + 2));
+  op->tag = offset | 1;
+
+  if (!slot->tag) {
+    *slot = *op;
+  }
+}
+
+// walks one basic block, returns once it branches, or runs into the start
+// of another one (which it then falls through to).
+static void walk_block(struct VB_Analysis* a, uint32_t addr) {
+  // registers holding a known constant, only tracked within the block.
+  uint32_t value[32] = {0};
+  uint32_t known = 1; // r0
+
+  for (;;) {
+    struct VB_DecodedOp op;
+    uint8_t* mark = mark_at(a, addr);
+
+    if (*mark & MARK_CODE) {
+      // already walked, from a branch into the middle of it.
+      return;
+    }
+
+    *mark |= MARK_CODE;
+    decode_at(a, addr, &op);
+
+    const uint32_t next = addr + op.size;
+    const bool reg1_known = known & (1u << op.reg1);
+
+    switch (op.opcode) {
+      case 0x10: // MOV imm
+        value[op.reg2] = op.imm;
+        known |= 1u << op.reg2;
+        break;
+
+      case 0x00: // MOV reg
+      case 0x28: // MOVEA
+      case 0x29: // ADDI
+      case 0x2F: // MOVHI
+        value[op.reg2] = value[op.reg1] + (op.opcode ? (uint32_t)op.imm : 0);
+        known = reg1_known ? (known | (1u << op.reg2)) : (known & ~(1u << op.reg2));
+        break;
+
+      case 0x20: case 0x21: case 0x22: case 0x23: // Bcond
+      case 0x24: case 0x25: case 0x26: case 0x27:
+        if (op.sub == COND_NEVER) {
+          break;
+        }
+
+        add_block(a, addr + op.imm);
+
+        if (op.sub != COND_ALWAYS) {
+          add_block(a, next);
+        }
+        return;
+
+      case 0x2A: // JR
+        add_block(a, addr + op.imm);
+        return;
+
+      case 0x2B: // JAL
+        add_function(a, addr + op.imm);
+        add_block(a, next);
+        return;
+
+      case 0x06: // JMP
+        if (op.reg1 != REG_LP && reg1_known) {
+          add_block(a, value[op.reg1]);
+        }
+        return;
+
+      case 0x18: // TRAP
+      case 0x1A: // HALT
+        // both carry on from the next op once the handler returns.
+        add_block(a, next);
+        return;
+
+      default:
+        // RETI and anything invalid end the walk.
+        if (op.flags & VB_OP_FLAG_BRANCH) {
+          return;
+        }
+
+        // anything other than a store could have changed reg2.
+        if (!is_store(op.opcode)) {
+          known &= ~(1u << op.reg2);
+        }
+
+        // the bit string ops move r26 - r30 along.
+        if (op.opcode == 0x1F) {
+          known &= ~(0x1Fu << 26);
+        }
+        break;
+    }
+
+    known |= 1; // r0 is always zero
+    value[0] = 0;
+    addr = next;
+
+    if (*mark_at(a, addr) & MARK_BLOCK) {
+      return;
+    }
+  }
+}
+
+static void analyse(struct VB_Analysis* a) {
+  for (size_t i = 0; i < VB_ARR_SIZE(VECTORS); i++) {
+    add_function(a, VECTORS[i]);
+  }
+
+  while (a->pending.count) {
+    walk_block(a, a->pending.data[--a->pending.count]);
+  }
+
+  qsort(a->blocks.data, a->blocks.count, sizeof(uint32_t), addr_compare);
+  qsort(a->functions.data, a->functions.count, sizeof(uint32_t), addr_compare);
+
+  free(a->pending.data);
+  memset(&a->pending, 0, sizeof(a->pending));
+}
+
+static bool is_done(const struct VB_Analysis* a) {
+  #ifdef VB_THREADS
+    return atomic_load_explicit(&a->done, memory_order_acquire);
+  #else
+    return a->done;
+  #endif
+}
+
+static void set_done(struct VB_Analysis* a) {
+  #ifdef VB_THREADS
+    atomic_store_explicit(&a->done, true, memory_order_release);
+  #else
+    a->done = true;
+  #endif
+}
+
+#ifdef VB_THREADS
+static void* analyse_thread(void* user) {
+  struct VB_Analysis* a = user;
+  analyse(a);
+  set_done(a);
+  return NULL;
+}
+#endif
+
+void vb_set_analysis(struct VB_Core* vb, enum VB_AnalysisMode mode) {
+  vb->analysis_mode = mode;
+}
+
+void vb_analysis_start(struct VB_Core* vb) {
+  vb_analysis_free(vb);
+
+  if (vb->analysis_mode == VB_AnalysisMode_OFF) {
+    return;
+  }
+
+  struct VB_Analysis* a = calloc(1, sizeof(*a));
+
+  if (!a) {
+    return;
+  }
+
+  a->rom = vb->rom;
+  a->rom_mask = vb->rom_mask;
+  a->marks = calloc(vb->rom_size / 2, sizeof(*a->marks));
+  a->ops = calloc(VB_PREDECODE_ENTRIES, sizeof(*a->ops));
+
+  if (!a->marks || !a->ops) {
+    vb_log_err("[ANALYSIS] failed to allocate tables\n");
+    free(a->marks);
+    free(a->ops);
+    free(a);
+    return;
+  }
+
+  vb->analysis = a;
+  vb->analysis_pending = true;
+
+  #ifdef VB_THREADS
+    atomic_init(&a->done, false);
+
+    if (vb->analysis_mode == VB_AnalysisMode_THREAD) {
+      a->threaded = pthread_create(&a->thread, NULL, analyse_thread, a) == 0;
+
+      if (a->threaded) {
+        return;
+      }
+
+      vb_log_err("[ANALYSIS] failed to start thread, running it now\n");
+    }
+  #endif
+
+  analyse(a);
+  set_done(a);
+  vb_analysis_apply(vb);
+}
+
+void vb_analysis_apply(struct VB_Core* vb) {
+  struct VB_Analysis* a = vb->analysis;
+
+  if (!a || !is_done(a)) {
+    return;
+  }
+
+  vb_v810_warm(vb, a->ops, a->blocks.data, a->blocks.count);
+  vb->analysis_pending = false;
+}
+
+void vb_analysis_free(struct VB_Core* vb) {
+  struct VB_Analysis* a = vb->analysis;
+
+  if (!a) {
+    return;
+  }
+
+  #ifdef VB_THREADS
+    if (a->threaded) {
+      pthread_join(a->thread, NULL);
+    }
+  #endif
+
+  free(a->marks);
+  free(a->ops);
+  free(a->blocks.data);
+  free(a->functions.data);
+  free(a->pending.data);
+  free(a);
+
+  vb->analysis = NULL;
+  vb->analysis_pending = false;
+}
+
+bool vb_get_rom_analysis(const struct VB_Core* vb, struct VB_RomAnalysis* analysis) {
+  const struct VB_Analysis* a = vb->analysis;
+
+  if (!a || !is_done(a) || a->blocks.failed || a->functions.failed) {
+    return false;
+  }
+
+  analysis->blocks = a->blocks.data;
+  analysis->block_count = a->blocks.count;
+  analysis->functions = a->functions.data;
+  analysis->function_count = a->functions.count;
+  return true;
+}
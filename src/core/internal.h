@@ -68,6 +68,21 @@ extern "C" {
 #endif
 
 
+// the highest bit set (0-63), x can't be 0.
+#if __has_builtin(__builtin_clzll)
+  #define VB_HIGHEST_BIT64(x) (63 - __builtin_clzll(x))
+#else
+  static inline int vb_highest_bit64(uint64_t x) {
+    int bit = 0;
+    while (x >>= 1) {
+      bit++;
+    }
+    return bit;
+  }
+  #define VB_HIGHEST_BIT64(x) vb_highest_bit64(x)
+#endif
+
+
 // should only be used for functions that return a value but
 // all cases inside a switch have been handled.
 #if __has_builtin(__builtin_unreachable)
@@ -95,14 +110,102 @@ extern "C" {
 
 void vb_v810_reset(struct VB_Core* vb);
 void vb_vip_reset(struct VB_Core* vb);
+// stops the draw thread, if there is one.
+void vb_vip_quit(struct VB_Core* vb);
 void vb_vsu_reset(struct VB_Core* vb);
 void vb_timer_reset(struct VB_Core* vb);
 
 void vb_v810_run(struct VB_Core* vb);
-void vb_vip_run(struct VB_Core* vb, uint8_t cycles);
-void vb_vsu_run(struct VB_Core* vb, uint8_t cycles);
-void vb_timer_run(struct VB_Core* vb, uint8_t cycles);
+void vb_v810_flush_cache(struct VB_Core* vb);
+void vb_v810_invalidate_wram(struct VB_Core* vb, uint32_t addr);
+// decodes the instruction, next is the halfword after it (for 32-bit ops).
+void vb_v810_decode(struct VB_DecodedOp* op, uint16_t opcode, uint16_t next);
+// fills the empty predecode entries from ops (laid out the same way, can
+// be NULL), then builds the blocks that start at each address that isn't built yet.
+void vb_v810_warm(struct VB_Core* vb, const struct VB_DecodedOp* ops, const uint32_t* blocks, size_t count);
+// writes any flags that are still pending into the psw.
+void vb_v810_sync_flags(struct VB_Core* vb);
+// call after the psw is written from outside of the cpu (eg, loadstate).
+void vb_v810_load_flags(struct VB_Core* vb);
+// works out if an interrupt can be taken, call after the psw or irqs change.
+void vb_v810_update_irq(struct VB_Core* vb);
+// raises / drops the interrupt, the cpu takes it before its next block.
+void vb_irq_set(struct VB_Core* vb, enum VB_Irq irq, bool asserted);
+
+#ifdef VB_JIT
+bool vb_jit_compile(struct VB_Core* vb, struct VB_Block* block);
+void vb_jit_flush(struct VB_Core* vb);
+void vb_jit_quit(struct VB_Core* vb);
+void vb_v810_call_handler(struct VB_Core* vb, const struct VB_DecodedOp* op);
+#endif
+
+// [Analysis]
+// starts walking the rom if it's enabled, this frees the last analysis.
+void vb_analysis_start(struct VB_Core* vb);
+// warms the cpu caches with what was found, if it has finished.
+void vb_analysis_apply(struct VB_Core* vb);
+// waits for the thread (if any) and frees everything.
+void vb_analysis_free(struct VB_Core* vb);
+
+// [Scheduler]
+void vb_scheduler_reset(struct VB_Core* vb, uint64_t now);
+// adds the event, or moves it if it's already pending.
+void vb_scheduler_add(struct VB_Core* vb, enum VB_EventId id, uint64_t when);
+void vb_scheduler_remove(struct VB_Core* vb, enum VB_EventId id);
+// cycle the next event is due on, UINT64_MAX if there's none.
+uint64_t vb_scheduler_next(const struct VB_Core* vb);
+// runs every event that is due.
+void vb_scheduler_fire(struct VB_Core* vb);
+
+// runs the component's event now if it was due during this slice.
+void vb_scheduler_catch_up(struct VB_Core* vb, enum VB_EventId id);
+
+// the current cycle, this is always up to date, even mid block.
+static inline uint64_t vb_now(const struct VB_Core* vb) {
+  return vb->sched.slice_end - vb->cycles_left;
+}
+
+// the cpu can run a little past an event before the scheduler fires it,
+// so a component is brought up to date only when the cpu touches it.
+// the cpu on its own never calls into any of them.
+static inline void vb_sync(struct VB_Core* vb, enum VB_EventId id) {
+  const uint8_t slot = vb->sched.slot[id];
+
+  if (VB_UNLIKELY(slot && vb->sched.heap[slot - 1].when <= vb_now(vb))) {
+    vb_scheduler_catch_up(vb, id);
+  }
+}
 
+// these are called by the scheduler on the cycle they asked for, they
+// then add themselves back for whenever they next need to run.
+void vb_vip_run(struct VB_Core* vb, uint64_t when);
+void vb_vsu_run(struct VB_Core* vb, uint64_t when);
+void vb_timer_run(struct VB_Core* vb, uint64_t when);
+
+// adds the event for the component based on its current state.
+// used after loading a state, as the heap itself isn't saved.
+void vb_vip_schedule(struct VB_Core* vb);
+void vb_vsu_schedule(struct VB_Core* vb);
+void vb_timer_schedule(struct VB_Core* vb);
+
+uint16_t vb_timer_counter_read(struct VB_Core* vb);
+uint8_t vb_timer_tcr_read(struct VB_Core* vb);
+void vb_timer_reload_write(struct VB_Core* vb, bool high, uint8_t value);
+void vb_timer_tcr_write(struct VB_Core* vb, uint8_t value);
+
+// raises / drops the component's interrupt from its current state.
+void vb_vip_update_irq(struct VB_Core* vb);
+void vb_timer_update_irq(struct VB_Core* vb);
+
+
+// (re)builds the page table, this has to be done when the rom changes.
+void vb_bus_map(struct VB_Core* vb);
+// (re)builds vb->waits, this has to be done when WCR changes.
+void vb_bus_update_waits(struct VB_Core* vb);
+// stops / resumes writes to the page going straight to wram, so that
+// writes to code can be caught, see wram_check_code() in mem.c
+void vb_bus_protect_wram(struct VB_Core* vb, uint32_t addr);
+void vb_bus_unprotect_wram(struct VB_Core* vb, uint32_t addr);
 
 uint8_t vb_bus_read_8(struct VB_Core* vb, uint32_t addr);
 uint16_t vb_bus_read_16(struct VB_Core* vb, uint32_t addr);
@@ -66,6 +66,14 @@ static inline uint16_t read_array16(
   return value;
 }
 
+static inline uint32_t read_array32(
+  const uint8_t* array, const uint32_t addr, const uint32_t mask
+) {
+  uint32_t value;
+  memcpy(&value, array + (addr & mask), sizeof(value));
+  return value;
+}
+
 static inline void write_array8(
   uint8_t* array, const uint32_t addr, const uint8_t value, const uint32_t mask
 ) {
@@ -78,6 +86,12 @@ static inline void write_array16(
   memcpy(array + (addr & mask), &value, sizeof(value));
 }
 
+static inline void write_array32(
+  uint8_t* array, const uint32_t addr, const uint32_t value, const uint32_t mask
+) {
+  memcpy(array + (addr & mask), &value, sizeof(value));
+}
+
 
 static uint8_t io_read(struct VB_Core* vb, uint32_t addr) {
   #define IO_ADDR(a) ((a >> 2) & 0xF)
@@ -115,12 +129,10 @@ static uint8_t io_read(struct VB_Core* vb, uint32_t addr) {
 
   switch (IO_ADDR(addr)) {
     case IO_ADDR(IO_CCR):
-      vb_log_fatal("[IO] read CCR Link Communication Control Registern\n");
-      // return (vb->io.CCR & mask) | or_mask;
+      return (vb->link.CCR & mask) | or_mask;
 
     case IO_ADDR(IO_CCSR):
-      vb_log_fatal("[IO] read CCSR Link COMCNT Control Register\n");
-      // return (vb->io.CCSR & mask) | or_mask;
+      return (vb->link.CCSR & mask) | or_mask;
 
     case IO_ADDR(IO_CDTR):
       vb_log_fatal("[IO] read CDTR Link Transmitted Data Register\n");
@@ -139,24 +151,19 @@ static uint8_t io_read(struct VB_Core* vb, uint32_t addr) {
       // return (vb->io.SDHR & mask) | or_mask;
 
     case IO_ADDR(IO_TLR):
-      vb_log_fatal("[IO] read TLR Timer Counter Low Register\n");
-      // return (vb->io.TLR & mask) | or_mask;
+      return (vb_timer_counter_read(vb) & mask) | or_mask;
 
     case IO_ADDR(IO_THR):
-      vb_log_fatal("[IO] read THR Timer Counter High Register\n");
-      // return (vb->io.THR & mask) | or_mask;
+      return ((vb_timer_counter_read(vb) >> 8) & mask) | or_mask;
 
     case IO_ADDR(IO_TCR):
-      vb_log_fatal("[IO] read TCR Timer Control Register\n");
-      // return (vb->io.TCR & mask) | or_mask;
+      return (vb_timer_tcr_read(vb) & mask) | or_mask;
 
     case IO_ADDR(IO_WCR):
-      vb_log_fatal("[IO] read WCR Game Pak Wait Control Register\n");
-      // return (vb->io.WCR & mask) | or_mask;
+      return (vb->pak.WCR & mask) | or_mask;
 
     case IO_ADDR(IO_SCR):
-      vb_log_fatal("[IO] read SCR Game Pad Serial Control Register\n");
-      // return (vb->io.SCR & mask) | or_mask;
+      return (vb->pak.SCR & mask) | or_mask;
   }
 
   #undef IO_ADDR
@@ -164,18 +171,29 @@ static uint8_t io_read(struct VB_Core* vb, uint32_t addr) {
   return 0xFF;
 }
 
+// bit 7 of CCR, CCSR and SCR stops the source from interrupting.
+// the link port and the pad's serial transfer aren't emulated, so nothing
+// raises those lines yet, but setting the bit should still drop them.
+static void io_irq_inhibit(struct VB_Core* vb, enum VB_Irq irq, uint8_t value) {
+  if (value & 0x80) {
+    vb_irq_set(vb, irq, false);
+  }
+}
+
 static void io_write(struct VB_Core* vb, uint32_t addr, uint8_t value) {
   #define IO_ADDR(addr) ((addr >> 2) & 0xF)
 
   switch (IO_ADDR(addr)) {
     case IO_ADDR(IO_CCR):
       printf("[IO] write CCR Link Communication Control Registe addr: 0x%08Xrn value: 0x%02X\n", addr, value);
-      // vb->io.CCR = value;
+      vb->link.CCR = value & 0x94; // C-Int-Inh, C-Clk-Sel, C-Stat
+      io_irq_inhibit(vb, VB_Irq_LINK, value);
       break;
 
     case IO_ADDR(IO_CCSR):
       printf("[IO] write CCSR Link COMCNT Control Register addr: 0x%08X value: 0x%02X\n", addr, value);
-      // vb->io.CCSR = value;
+      vb->link.CCSR = value & 0x9F; // CC-Int-Inh, CC-Int-Lv, signal bits
+      io_irq_inhibit(vb, VB_Irq_LINK, value);
       break;
 
     case IO_ADDR(IO_CDTR):
@@ -200,27 +218,30 @@ static void io_write(struct VB_Core* vb, uint32_t addr, uint8_t value) {
 
     case IO_ADDR(IO_TLR):
       printf("[IO] write TLR Timer Counter Low Register addr: 0x%08X value: 0x%02X\n", addr, value);
-      vb->timer.TLR = value;
+      vb_timer_reload_write(vb, false, value);
       break;
 
     case IO_ADDR(IO_THR):
       printf("[IO] write THR Timer Counter High Register addr: 0x%08X value: 0x%02X\n", addr, value);
-      vb->timer.THR = value;
+      vb_timer_reload_write(vb, true, value);
       break;
 
     case IO_ADDR(IO_TCR):
       printf("[IO] write TCR Timer Control Register addr: 0x%08X value: 0x%02X\n", addr, value);
-      vb->timer.TCR = value;
+      vb_timer_tcr_write(vb, value);
       break;
 
     case IO_ADDR(IO_WCR):
       printf("[IO] write WCR Game Pak Wait Control Register addr: 0x%08X value: 0x%02X\n", addr, value);
-      // vb->io.WCR = value;
+      vb->pak.WCR = value; // only the lower 2 bits are used
+      vb_bus_update_waits(vb);
       break;
 
     case IO_ADDR(IO_SCR):
       printf("[IO] write SCR Game Pad Serial Control Register addr: 0x%08X value: 0x%02X\n", addr, value);
-      // vb->io.SCR = value;
+      // only K-Int-Inh and Para/Si stick, the rest are strobes / status.
+      vb->pak.SCR = value & 0xA0;
+      io_irq_inhibit(vb, VB_Irq_PAD, value);
       break;
   }
 
@@ -260,15 +281,37 @@ static uint16_t wram_read_16(struct VB_Core* vb, uint32_t addr) {
   return read_array16(vb->wram, addr, 0xFFFF);
 }
 
+static uint32_t wram_read_32(struct VB_Core* vb, uint32_t addr) {
+  assert(!(addr & 0x3) && "unaligned addr in wram_read_32!");
+  return read_array32(vb->wram, addr, 0xFFFF);
+}
+
+// if the page being written to has been run as code, then the blocks
+// built from it have to be thrown away.
+static inline void wram_check_code(struct VB_Core* vb, uint32_t addr) {
+  if (VB_UNLIKELY(vb->wram_code[(addr & 0xFFFF) >> VB_WRAM_CODE_PAGE_SHIFT])) {
+    vb_v810_invalidate_wram(vb, addr);
+  }
+}
+
 static void wram_write_8(struct VB_Core* vb, uint32_t addr, uint8_t value) {
+  wram_check_code(vb, addr);
   write_array8(vb->wram, addr, value, 0xFFFF);
 }
 
 static void wram_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
   assert(!(addr & 0x1) && "unaligned addr in wram_write_16!");
+  wram_check_code(vb, addr);
   write_array16(vb->wram, addr, value, 0xFFFF);
 }
 
+// both halves are always in the same code page, so it's only checked once.
+static void wram_write_32(struct VB_Core* vb, uint32_t addr, uint32_t value) {
+  assert(!(addr & 0x3) && "unaligned addr in wram_write_32!");
+  wram_check_code(vb, addr);
+  write_array32(vb->wram, addr, value, 0xFFFF);
+}
+
 
 static uint8_t game_ram_read_8(struct VB_Core* vb, uint32_t addr) {
   VB_UNUSED(vb); VB_UNUSED(addr);
@@ -303,6 +346,11 @@ static uint16_t game_rom_read_16(struct VB_Core* vb, uint32_t addr) {
   return read_array16(vb->rom, addr, vb->rom_mask);
 }
 
+static uint32_t game_rom_read_32(struct VB_Core* vb, uint32_t addr) {
+  assert(!(addr & 0x3) && "unaligned addr in game_rom_read_32!");
+  return read_array32(vb->rom, addr, vb->rom_mask);
+}
+
 static void game_rom_write_8(struct VB_Core* vb, uint32_t addr, uint8_t value) {
   VB_UNUSED(vb); VB_UNUSED(addr); VB_UNUSED(value);
 }
@@ -312,9 +360,132 @@ static void game_rom_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value)
 }
 
 
+// [Wait States]
+// what an access costs only changes when WCR is written, so it's worked
+// out for every region then, and an access is just a lookup.
+//
+// only the game pak is known to add wait states, vip, vsu and wram are
+// 0 wait (the cost of the access is part of the instruction's cycles).
+enum {
+  REGION_EXP = 0x4,
+  REGION_ROM = 0x7,
+
+  WCR_ROM1W = 1 << 0,
+  WCR_EXP1W = 1 << 1,
+};
+
+// the game pak bus is 16-bits wide, so a word is 2 accesses.
+static void set_pak_waits(struct VB_Core* vb, uint8_t region, uint8_t waits) {
+  vb->waits[region][VB_Access_8] = waits;
+  vb->waits[region][VB_Access_16] = waits;
+  vb->waits[region][VB_Access_32] = waits * 2;
+  vb->waits[region][VB_Access_FETCH] = waits;
+}
+
+void vb_bus_update_waits(struct VB_Core* vb) {
+  memset(vb->waits, 0, sizeof(vb->waits));
+
+  set_pak_waits(vb, REGION_EXP, (vb->pak.WCR & WCR_EXP1W) ? 1 : 2);
+  set_pak_waits(vb, REGION_ROM, (vb->pak.WCR & WCR_ROM1W) ? 1 : 2);
+}
+
+
+// [Page Table]
+// ram and rom are mapped straight to host memory, so most accesses are a
+// shift, a lookup and a memcpy. anything with side effects (io, or wram
+// that has been run as code) is left unmapped and goes to the handlers.
+#define PAGE(addr) (((addr) >> VB_PAGE_SHIFT) & (VB_PAGE_COUNT - 1))
+
+static void map_pages(
+  struct VB_Core* vb, uint32_t addr, const uint8_t* read, uint8_t* write, uint32_t size
+) {
+  for (uint32_t offset = 0; offset < size; offset += VB_PAGE_SIZE) {
+    vb->read_pages[PAGE(addr + offset)] = read + offset;
+    vb->write_pages[PAGE(addr + offset)] = write ? write + offset : NULL;
+  }
+}
+
+// the character tables are 8 KiB, they can't share a page with a frame buffer.
+static_assert(VB_PAGE_SIZE <= 0x2000, "pages are too big to map the character tables on their own");
+
+void vb_bus_map(struct VB_Core* vb) {
+  memset(vb->read_pages, 0, sizeof(vb->read_pages));
+  memset(vb->write_pages, 0, sizeof(vb->write_pages));
+
+  // the vip is mirrored every 512 KiB, the io is in the unmapped part.
+  // every write goes through vip_write_16(), which brings the vip up to
+  // date first (so a write can't land in a frame that should already have
+  // been drawn), and keeps the characters and objects it has cached in
+  // step. only what the vip never writes itself is mapped for reads, the
+  // frame buffers aren't.
+  for (uint32_t base = VIP_BEG; base < VIP_END; base += 0x80000) {
+    uint8_t* vram = (uint8_t*)vb->vip.vram;
+    uint8_t* dram = (uint8_t*)vb->vip.dram;
+
+    map_pages(vb, base + 0x20000, dram, NULL, sizeof(vb->vip.dram));
+
+    // the 4 character tables and their mirrors, see vip_get_character_table().
+    for (uint32_t i = 0; i < 4; i++) {
+      uint8_t* table = vram + 0x6000 + 0x8000 * i;
+      map_pages(vb, base + 0x6000 + 0x8000 * i, table, NULL, 0x2000);
+      map_pages(vb, base + 0x78000 + 0x2000 * i, table, NULL, 0x2000);
+    }
+  }
+
+  for (uint32_t base = WRAM_BEG; base < WRAM_END; base += sizeof(vb->wram)) {
+    map_pages(vb, base, vb->wram, vb->wram, sizeof(vb->wram));
+  }
+
+  // a rom smaller than a page can't be mapped, it mirrors within the page.
+  if (vb->rom && vb->rom_size >= VB_PAGE_SIZE) {
+    for (uint32_t base = PAK_ROM_BEG; base < PAK_ROM_END; base += vb->rom_size) {
+      map_pages(vb, base, vb->rom, NULL, vb->rom_size);
+    }
+  }
+
+  // pak ram and the expansion have nothing behind them yet.
+
+  for (uint32_t i = 0; i < VB_ARR_SIZE(vb->wram_code); i++) {
+    if (vb->wram_code[i]) {
+      vb_bus_protect_wram(vb, i << VB_WRAM_CODE_PAGE_SHIFT);
+    }
+  }
+}
+
+void vb_bus_protect_wram(struct VB_Core* vb, uint32_t addr) {
+  const uint32_t offset = (addr & 0xFFFF) & ~(VB_PAGE_SIZE - 1);
+
+  for (uint32_t base = WRAM_BEG; base < WRAM_END; base += sizeof(vb->wram)) {
+    vb->write_pages[PAGE(base + offset)] = NULL;
+  }
+}
+
+void vb_bus_unprotect_wram(struct VB_Core* vb, uint32_t addr) {
+  const uint32_t offset = (addr & 0xFFFF) & ~(VB_PAGE_SIZE - 1);
+
+  // the page can only go back to being written directly once none of the
+  // code pages inside of it are still in use.
+  for (uint32_t i = 0; i < VB_PAGE_SIZE; i += 1 << VB_WRAM_CODE_PAGE_SHIFT) {
+    if (vb->wram_code[(offset + i) >> VB_WRAM_CODE_PAGE_SHIFT]) {
+      return;
+    }
+  }
+
+  for (uint32_t base = WRAM_BEG; base < WRAM_END; base += sizeof(vb->wram)) {
+    vb->write_pages[PAGE(base + offset)] = vb->wram + offset;
+  }
+}
+
+
 #define BUS_ADDR(addr) (((addr) >> 24) & 0x7)
 
 uint8_t vb_bus_read_8(struct VB_Core* vb, uint32_t addr) {
+  const uint8_t* page = vb->read_pages[PAGE(addr)];
+
+  if (VB_LIKELY(page != NULL)) {
+    return read_array8(page, addr, VB_PAGE_SIZE - 1);
+  }
+
   switch (BUS_ADDR(addr)) {
     case BUS_ADDR(0x00000000): return vip_read_8(vb, addr);
     case BUS_ADDR(0x01000000): return vsu_read_8(vb, addr);
@@ -330,6 +501,12 @@ uint8_t vb_bus_read_8(struct VB_Core* vb, uint32_t addr) {
 }
 
 uint16_t vb_bus_read_16(struct VB_Core* vb, uint32_t addr) {
+  const uint8_t* page = vb->read_pages[PAGE(addr)];
+
+  if (VB_LIKELY(page != NULL)) {
+    return read_array16(page, addr, VB_PAGE_SIZE - 1);
+  }
+
   switch (BUS_ADDR(addr)) {
     case BUS_ADDR(0x00000000): return vip_read_16(vb, addr);
     case BUS_ADDR(0x01000000): return vsu_read_16(vb, addr);
@@ -344,15 +521,36 @@ uint16_t vb_bus_read_16(struct VB_Core* vb, uint32_t addr) {
   }
 }
 
+// the bus is 16-bit, so the hardware splits word accesses in two. that only
+// matters for io, ram and rom are read / written in one go.
 uint32_t vb_bus_read_32(struct VB_Core* vb, uint32_t addr) {
-  const uint32_t lo = vb_bus_read_16(vb, addr + 0);
-  const uint32_t hi = vb_bus_read_16(vb, addr + 2);
+  const uint8_t* page = vb->read_pages[PAGE(addr)];
+
+  if (VB_LIKELY(page != NULL)) {
+    return read_array32(page, addr, VB_PAGE_SIZE - 1);
+  }
 
-  return (hi << 16) | lo;
+  switch (BUS_ADDR(addr)) {
+    case BUS_ADDR(0x05000000): return wram_read_32(vb, addr);
+    case BUS_ADDR(0x07000000): return game_rom_read_32(vb, addr);
+    default: {
+      const uint32_t lo = vb_bus_read_16(vb, addr + 0);
+      const uint32_t hi = vb_bus_read_16(vb, addr + 2);
+
+      return (hi << 16) | lo;
+    }
+  }
 }
 
 
 void vb_bus_write_8(struct VB_Core* vb, uint32_t addr, uint8_t value) {
+  uint8_t* page = vb->write_pages[PAGE(addr)];
+
+  if (VB_LIKELY(page != NULL)) {
+    write_array8(page, addr, value, VB_PAGE_SIZE - 1);
+    return;
+  }
+
   switch (BUS_ADDR(addr)) {
     case BUS_ADDR(0x00000000): vip_write_8(vb, addr, value); break;
     case BUS_ADDR(0x01000000): vsu_write_8(vb, addr, value); break;
@@ -368,6 +566,13 @@ void vb_bus_write_8(struct VB_Core* vb, uint32_t addr, uint8_t value) {
 }
 
 void vb_bus_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
+  uint8_t* page = vb->write_pages[PAGE(addr)];
+
+  if (VB_LIKELY(page != NULL)) {
+    write_array16(page, addr, value, VB_PAGE_SIZE - 1);
+    return;
+  }
+
   switch (BUS_ADDR(addr)) {
     case BUS_ADDR(0x00000000): vip_write_16(vb, addr, value); break;
     case BUS_ADDR(0x01000000): vsu_write_16(vb, addr, value); break;
@@ -383,8 +588,22 @@ void vb_bus_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
 }
 
 void vb_bus_write_32(struct VB_Core* vb, uint32_t addr, uint32_t value) {
-  vb_bus_write_16(vb, addr + 0, value >> 0);
-  vb_bus_write_16(vb, addr + 2, value >> 16);
+  uint8_t* page = vb->write_pages[PAGE(addr)];
+
+  if (VB_LIKELY(page != NULL)) {
+    write_array32(page, addr, value, VB_PAGE_SIZE - 1);
+    return;
+  }
+
+  switch (BUS_ADDR(addr)) {
+    case BUS_ADDR(0x05000000): wram_write_32(vb, addr, value); break;
+    case BUS_ADDR(0x07000000): break; // rom
+    default:
+      vb_bus_write_16(vb, addr + 0, value >> 0);
+      vb_bus_write_16(vb, addr + 2, value >> 16);
+      break;
+  }
 }
 
 #undef BUS_ADDR
+#undef PAGE
@@ -0,0 +1,154 @@
+/**
+ * Copyright 2022 TotalJustice.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vb.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+// [Scheduler]
+// everything outside of the cpu says when it next needs to run, rather
+// than being ticked along with it. the cpu then runs freely until the
+// earliest of those, see vb_run_cycles().
+//
+// there's only a handful of events, so the heap is tiny, but it keeps
+// finding the next one O(1) and adding / moving one O(log n).
+
+static bool event_before(const struct VB_Event* a, const struct VB_Event* b) {
+  // ties are broken on the id so the order things fire in never changes.
+  return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+static void heap_set(struct VB_Scheduler* s, uint8_t i, struct VB_Event event) {
+  s->heap[i] = event;
+  s->slot[event.id] = i + 1;
+}
+
+static void sift_up(struct VB_Scheduler* s, uint8_t i) {
+  const struct VB_Event event = s->heap[i];
+
+  while (i > 0) {
+    const uint8_t parent = (i - 1) / 2;
+
+    if (!event_before(&event, &s->heap[parent])) {
+      break;
+    }
+
+    heap_set(s, i, s->heap[parent]);
+    i = parent;
+  }
+
+  heap_set(s, i, event);
+}
+
+static void sift_down(struct VB_Scheduler* s, uint8_t i) {
+  const struct VB_Event event = s->heap[i];
+
+  for (;;) {
+    uint8_t child = i * 2 + 1;
+
+    if (child >= s->count) {
+      break;
+    }
+
+    if (child + 1 < s->count && event_before(&s->heap[child + 1], &s->heap[child])) {
+      child++;
+    }
+
+    if (!event_before(&s->heap[child], &event)) {
+      break;
+    }
+
+    heap_set(s, i, s->heap[child]);
+    i = child;
+  }
+
+  heap_set(s, i, event);
+}
+
+void vb_scheduler_reset(struct VB_Core* vb, uint64_t now) {
+  memset(&vb->sched, 0, sizeof(vb->sched));
+  vb->sched.slice_end = now;
+  vb->sched.target = now;
+  vb->cycles_left = 0;
+}
+
+void vb_scheduler_add(struct VB_Core* vb, enum VB_EventId id, uint64_t when) {
+  assert(id < VB_Event_MAX);
+  struct VB_Scheduler* s = &vb->sched;
+
+  if (s->slot[id]) {
+    const uint8_t i = s->slot[id] - 1;
+    s->heap[i].when = when;
+    sift_up(s, i);
+    sift_down(s, s->slot[id] - 1);
+  }
+  else {
+    const uint8_t i = s->count++;
+    heap_set(s, i, (struct VB_Event){ .when = when, .id = id });
+    sift_up(s, i);
+  }
+
+  // this can be called by the cpu (writing to a register), in which case
+  // the slice it is running may now go past this, so cut it short.
+  if (when < s->slice_end) {
+    vb->cycles_left -= (int32_t)(s->slice_end - when);
+    s->slice_end = when;
+  }
+}
+
+void vb_scheduler_remove(struct VB_Core* vb, enum VB_EventId id) {
+  assert(id < VB_Event_MAX);
+  struct VB_Scheduler* s = &vb->sched;
+
+  if (!s->slot[id]) {
+    return;
+  }
+
+  const uint8_t i = s->slot[id] - 1;
+  const uint8_t last = --s->count;
+  s->slot[id] = 0;
+
+  if (i != last) {
+    heap_set(s, i, s->heap[last]);
+    sift_up(s, i);
+    sift_down(s, s->slot[s->heap[i].id] - 1);
+  }
+}
+
+uint64_t vb_scheduler_next(const struct VB_Core* vb) {
+  return vb->sched.count ? vb->sched.heap[0].when : UINT64_MAX;
+}
+
+// events are given the cycle they were due on, not when the cpu got
+// round to them, so they don't drift by however much it ran over.
+static void event_run(struct VB_Core* vb, struct VB_Event event) {
+  vb_scheduler_remove(vb, event.id);
+
+  switch ((enum VB_EventId)event.id) {
+    case VB_Event_TIMER: vb_timer_run(vb, event.when); break;
+    case VB_Event_VIP: vb_vip_run(vb, event.when); break;
+    case VB_Event_VSU: vb_vsu_run(vb, event.when); break;
+    case VB_Event_MAX: assert(!"invalid event"); break;
+  }
+}
+
+void vb_scheduler_fire(struct VB_Core* vb) {
+  const uint64_t now = vb_now(vb);
+
+  while (vb->sched.count && vb->sched.heap[0].when <= now) {
+    event_run(vb, vb->sched.heap[0]);
+  }
+}
+
+void vb_scheduler_catch_up(struct VB_Core* vb, enum VB_EventId id) {
+  const uint64_t now = vb_now(vb);
+
+  while (vb->sched.slot[id] && vb->sched.heap[vb->sched.slot[id] - 1].when <= now) {
+    event_run(vb, vb->sched.heap[vb->sched.slot[id] - 1]);
+  }
+}
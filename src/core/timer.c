@@ -12,10 +12,138 @@
 #include <string.h>
 
 
-void vb_timer_run(struct VB_Core* vb, uint8_t cycles) {
+/*
+[some notes]
 
+- the counter ticks down every 100us or 20us, once it hits zero, Z-Stat is
+  set (and the interrupt raised if enabled), then on the next tick it is
+  reloaded from TLR / THR. so a reload value of N fires every N+1 ticks.
+
+- nothing ticks it along. the counter is only brought up to date when it's
+  read, or the settings change, and the scheduler is told when it next hits
+  zero, which is the only time anything has to happen.
+*/
+
+enum {
+  TCR_ENABLE = 1 << 0, // T-Enb
+  TCR_ZSTAT = 1 << 1, // Z-Stat (read only)
+  TCR_ZSTAT_CLR = 1 << 2, // Z-Stat-Clr (write only)
+  TCR_INTERRUPT = 1 << 3, // Tim-Z-Int
+  TCR_CLOCK = 1 << 4, // T-Clk-Sel, 1=20us 0=100us
+
+  TICK_100US = VB_CPU_SPEED / 10000,
+  TICK_20US = VB_CPU_SPEED / 50000,
+};
+
+static inline bool timer_is_enabled(const struct VB_Core* vb) {
+  return vb->timer.TCR & TCR_ENABLE;
+}
+
+static inline uint32_t timer_tick_cycles(const struct VB_Core* vb) {
+  return (vb->timer.TCR & TCR_CLOCK) ? TICK_20US : TICK_100US;
+}
+
+static inline uint16_t timer_reload(const struct VB_Core* vb) {
+  return (vb->timer.THR << 8) | vb->timer.TLR;
+}
+
+// brings the counter up to now.
+static void timer_sync(struct VB_Core* vb, uint64_t now) {
+  if (!timer_is_enabled(vb) || now <= vb->timer.last_tick) {
+    return;
+  }
+
+  const uint32_t tick = timer_tick_cycles(vb);
+  uint64_t ticks = (now - vb->timer.last_tick) / tick;
+  vb->timer.last_tick += ticks * tick;
+
+  if (ticks <= vb->timer.counter) {
+    vb->timer.counter -= ticks;
+  }
+  else {
+    // it went past zero (the event for that is still due), so work out
+    // where it got to after the reload.
+    const uint32_t reload = timer_reload(vb);
+    ticks -= vb->timer.counter;
+    vb->timer.counter = reload - ((ticks - 1) % (reload + 1));
+  }
+}
+
+void vb_timer_schedule(struct VB_Core* vb) {
+  if (!timer_is_enabled(vb)) {
+    vb_scheduler_remove(vb, VB_Event_TIMER);
+    return;
+  }
+
+  // when it's sat on zero, the next zero is after the reload.
+  const uint64_t ticks = vb->timer.counter ? vb->timer.counter : timer_reload(vb) + 1;
+  vb_scheduler_add(vb, VB_Event_TIMER, vb->timer.last_tick + ticks * timer_tick_cycles(vb));
+}
+
+// raised for as long as Z-Stat is set with the interrupt enabled.
+void vb_timer_update_irq(struct VB_Core* vb) {
+  vb_irq_set(vb, VB_Irq_TIMER, (vb->timer.TCR & TCR_ZSTAT) && (vb->timer.TCR & TCR_INTERRUPT));
+}
+
+uint16_t vb_timer_counter_read(struct VB_Core* vb) {
+  vb->timed_read = true;
+  vb_sync(vb, VB_Event_TIMER);
+  timer_sync(vb, vb_now(vb));
+  return vb->timer.counter;
+}
+
+uint8_t vb_timer_tcr_read(struct VB_Core* vb) {
+  vb_sync(vb, VB_Event_TIMER);
+  return vb->timer.TCR;
+}
+
+void vb_timer_reload_write(struct VB_Core* vb, bool high, uint8_t value) {
+  if (high) {
+    vb->timer.THR = value;
+  }
+  else {
+    vb->timer.TLR = value;
+  }
+
+  // writing either half also resets the counter.
+  vb->timer.counter = timer_reload(vb);
+  vb->timer.last_tick = vb_now(vb);
+  vb_timer_schedule(vb);
+}
+
+void vb_timer_tcr_write(struct VB_Core* vb, uint8_t value) {
+  const uint64_t now = vb_now(vb);
+  const bool was_enabled = timer_is_enabled(vb);
+
+  // count up to now with the old settings before they change.
+  timer_sync(vb, now);
+
+  if (value & TCR_ZSTAT_CLR) {
+    vb->timer.TCR &= ~TCR_ZSTAT;
+  }
+
+  vb->timer.TCR = (vb->timer.TCR & TCR_ZSTAT) | (value & (TCR_ENABLE | TCR_INTERRUPT | TCR_CLOCK));
+  vb_timer_update_irq(vb);
+
+  if (!was_enabled) {
+    vb->timer.last_tick = now;
+  }
+
+  vb_timer_schedule(vb);
+}
+
+void vb_timer_run(struct VB_Core* vb, uint64_t when) {
+  // this is only ever scheduled for when the counter hits zero.
+  // it might already be past that, if it was read just before this fired.
+  timer_sync(vb, when);
+  vb->timer.TCR |= TCR_ZSTAT;
+  vb_timer_update_irq(vb);
+
+  vb_timer_schedule(vb);
 }
 
 void vb_timer_reset(struct VB_Core* vb) {
   memset(&vb->timer, 0, sizeof(vb->timer));
+  vb_timer_update_irq(vb);
+  vb_scheduler_remove(vb, VB_Event_TIMER);
 }
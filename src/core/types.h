@@ -161,6 +161,15 @@ struct VB_Cpu {
 
 // [Common VIP Terms]
 // characters = tiles
+enum {
+  VB_VIP_WIDTH = 384,
+  VB_VIP_HEIGHT = 224,
+  // 4 tables of 512, see vip_get_character_table() in vip.c
+  VB_VIP_CHARS = 2048,
+  VB_VIP_WORLDS = 32,
+  VB_VIP_OBJECTS = 1024,
+};
+
 // objects = sprites
 // worlds = windows
 struct VB_Vip {
@@ -168,6 +177,8 @@ struct VB_Vip {
   uint16_t vram[1024 * 128 / 2];
   // backgrounds, coloumn table windows, oam
   uint16_t dram[1024 * 128 / 2];
+  // never read or written by the cpu, see VB_VipCache.
+  uint16_t dram_pad[2];
 
   uint16_t INTPND;  // Interrupt Pending
   uint16_t INTENB;  // Interrupt Enable
@@ -197,6 +208,13 @@ struct VB_Vip {
   uint16_t JPLT3;   // OBJ Palette Control Register 3
   uint16_t BKCOL;   // BG Color Palette Control Register
 
+  // [timing], see vb_vip_run()
+  uint64_t frame_start; // cycle the current display frame started on
+  uint8_t frame_event;  // what happens next in this frame
+  uint8_t game_frame;   // display frames since the last game frame started
+  bool drawing;         // drawing to the frame buffers this game frame
+  uint8_t frame_buffer; // frame buffer pair (0/1) being drawn to
+
   // characters are also known as tiles
   // uint16_t characters[2048];
 
@@ -210,6 +228,33 @@ struct VB_Vip {
   // there's 32 worlds
 };
 
+// what the vip draws with, see [Characters], [Objects] and [Drawing] in
+// vip.c. none of this is saved, it's all rebuilt from vram and dram.
+struct VB_VipCache {
+  // each character as a pixel (0-3) per byte, [0] as it is and [1] flipped
+  // horizontally. a vertical flip only needs the rows read backwards.
+  uint8_t chars[VB_VIP_CHARS][2][8][8];
+  // the affine kernel's gathers read 4 bytes at a time, the pad here and
+  // the ones after char_valid / dram keep the last read inside the array.
+  uint8_t chars_pad[4];
+  // cleared when vip_write_16() touches any byte of the character.
+  bool char_valid[VB_VIP_CHARS];
+  uint8_t char_valid_pad[4];
+
+  // the objects on each 8 row block of the screen, for each eye, a bit per
+  // object. kept up to date by vip_write_16(), see vip_bin_object().
+  uint64_t obj_bins[2][VB_VIP_HEIGHT / 8][VB_VIP_OBJECTS / 64];
+  // cleared by reset / loadstate, they're all binned again when drawing.
+  bool obj_bins_valid;
+
+  // each eye is drawn here a pixel per byte (palette applied), then
+  // packed into the frame buffer.
+  uint8_t eyes[2][VB_VIP_HEIGHT][VB_VIP_WIDTH];
+
+  // set by vb_vip_reset() if the cpu has avx2, for the affine kernel.
+  bool avx2;
+};
+
 // has 6 channels, 5 pcm samples, 1 noise
 // channel all: len, stereo, envelope, freq control (timer)
 // channel 1-4: pcm
@@ -269,6 +314,9 @@ struct VB_Vsu {
 
     uint8_t sampling_position; // the position in waveram
     uint8_t sample; // current sample
+
+    uint64_t step_start; // cycle sampling_position was last updated on
+    uint64_t stop_at; // cycle the channel stops on if mode=1, 0 = never
   } channels[6];
 
   // Base Address Setting Register
@@ -302,6 +350,7 @@ struct VB_Timer {
   // } TCR;
 
   uint16_t counter;
+  uint64_t last_tick; // cycle the counter was last updated on
 };
 
 struct VB_Pad {
@@ -321,8 +370,193 @@ struct VB_Pak {
   uint8_t SCR;  // Serial Control Register
 };
 
+struct VB_Core;
+struct VB_DecodedOp;
+
+typedef void (*VB_OpHandler)(struct VB_Core* vb, const struct VB_DecodedOp* op);
+
+enum VB_DecodedOpFlag {
+  // the instruction (may) change the pc, so it has to end a block.
+  VB_OP_FLAG_BRANCH = 1 << 0,
+};
+
+// an instruction that has already been fetched and decoded.
+struct VB_DecodedOp {
+  VB_OpHandler handler; // function that executes the instruction
+  int32_t imm;  // imm / disp, already sign (or zero) extended
+  uint32_t tag; // (rom offset | 1) this was decoded from, 0 = empty
+  uint8_t reg1;
+  uint8_t reg2;
+  uint8_t sub;  // bcond cond, format7 subop or bit string subop
+  uint8_t size; // size of the instruction in bytes (2 or 4)
+  uint8_t flags; // VB_DecodedOpFlag
+  uint8_t opcode; // the 6-bit primary opcode
+  uint8_t id; // what the dispatcher jumps on (opcode, or resolved subop)
+  uint8_t cycles; // base cycles, not including any wait states
+};
+
+enum {
+  // direct mapped on the rom offset, this covers 256 KiB of code before
+  // any two instructions start to fight over the same entry.
+  VB_PREDECODE_ENTRIES = 1024 * 128,
+
+  // a block is cut short if it doesn't branch within this many instructions.
+  VB_BLOCK_MAX_OPS = 32,
+  // direct mapped on the start address of the block.
+  VB_BLOCK_ENTRIES = 1024 * 4,
+
+  // the bus is mapped to host memory in pages of this size, see mem.c
+  // the map covers the 27-bit address space, everything above mirrors it.
+  VB_PAGE_SHIFT = 13,
+  VB_PAGE_SIZE = 1 << VB_PAGE_SHIFT,
+  VB_PAGE_COUNT = 1 << (27 - VB_PAGE_SHIFT),
+
+  // number of different idle loops that stats are kept for.
+  VB_IDLE_LOOP_MAX = 16,
+
+  // granularity that wram is tracked at for blocks built from it.
+  VB_WRAM_CODE_PAGE_SHIFT = 8,
+  VB_WRAM_CODE_PAGES = (1024 * 64) >> VB_WRAM_CODE_PAGE_SHIFT,
+
+  // the instruction cache is 128 lines of 2 words (1 KiB).
+  VB_ICACHE_LINES = 128,
+  VB_ICACHE_WORDS = VB_ICACHE_LINES * 2,
+};
+
+// a straight line run of instructions, ending in a branch.
+struct VB_Block {
+  uint32_t tag;   // (start address | 1), 0 = empty
+  uint32_t end;   // address of the instruction after the last one
+  uint16_t count; // number of ops
+  uint16_t fetches; // halfwords fetched, each one costs the rom wait states
+  bool wram;      // built from wram, so can be invalidated by writes
+  bool idle;      // loops on itself without changing anything, see v810.c
+
+  // successors that this block has been seen to jump to.
+  // [0] = fall through (branch not taken), [1] = branch taken.
+  // these are only a hint, the tag of the successor is always checked.
+  struct VB_Block* next[2];
+
+  // native version of the block, only used when built with the jit.
+  // returns the number of instructions that were executed.
+  uint32_t (*code)(struct VB_Core* vb);
+
+  struct VB_DecodedOp ops[VB_BLOCK_MAX_OPS];
+};
+
+// the v810's instruction cache, see [Cache] in v810.c
+// code is always run from memory, this is only used for the timing.
+struct VB_ICache {
+  // (address of the word | 1) that each word of the cache holds, 0 = invalid.
+  uint32_t tags[VB_ICACHE_WORDS];
+  uint64_t hits;
+  uint64_t misses;
+};
+
+// an idle loop that the cpu has skipped, see vb_get_idle_loops().
+struct VB_IdleLoop {
+  uint32_t addr; // start of the loop
+  uint64_t cycles; // total cycles skipped
+};
+
+// what the last alu op left the flags as, only turned into the psw
+// bits when something reads them, see [Flags] in v810.c.
+// this isn't saved, the psw is brought up to date before a savestate.
+struct VB_LazyFlags {
+  uint32_t result; // Z and S come from this
+  uint32_t overflow; // OV is bit 31 of this
+  // CY = carry_a < carry_b, logic ops leave these alone.
+  uint32_t carry_a;
+  uint32_t carry_b;
+  bool pending; // the psw flags are out of date
+};
+
+// pairs of instructions that blocks run as one, see vb_get_fusion_hits().
+enum VB_Fusion {
+  VB_Fusion_MOVHI_MOVEA, // building a 32-bit constant
+  VB_Fusion_MOVHI_LOAD, // load from an absolute address
+  VB_Fusion_MOVHI_STORE, // store to an absolute address
+  VB_Fusion_CMP_BCOND, // compare and branch
+  VB_Fusion_MAX,
+};
+
+// kinds of bus access, as each can cost a different number of wait states.
+enum VB_Access {
+  VB_Access_8,
+  VB_Access_16,
+  VB_Access_32,
+  VB_Access_FETCH, // a halfword of an instruction
+  VB_Access_MAX,
+};
+
+// interrupt sources, the value is also the level, higher wins.
+enum VB_Irq {
+  VB_Irq_PAD, // key input
+  VB_Irq_TIMER, // timer zero
+  VB_Irq_PAK, // game pak, expansion
+  VB_Irq_LINK, // communication port
+  VB_Irq_VIP, // video
+  VB_Irq_MAX,
+};
+
+// when (and if) the rom is walked for code after it's loaded, see analysis.c
+enum VB_AnalysisMode {
+  VB_AnalysisMode_OFF,
+  VB_AnalysisMode_BLOCKING, // during vb_loadrom()
+  VB_AnalysisMode_THREAD, // on a thread, blocking if built without threads
+};
+
+// what the rom analysis found, see vb_get_rom_analysis().
+// both are sorted, and every function entry is also a block start.
+struct VB_RomAnalysis {
+  const uint32_t* blocks; // start address of each basic block
+  size_t block_count;
+  const uint32_t* functions; // vectors and jal targets
+  size_t function_count;
+};
+
+// private to analysis.c
+struct VB_Analysis;
+// private to vip.c
+struct VB_VipWorker;
+
+// buffer that the jit emits code into, see v810_jit.c
+struct VB_Jit {
+  uint8_t* buffer;
+  size_t size;
+  size_t used;
+};
+
+// everything that happens at a fixed time outside of the cpu.
+// each one can only be pending once, adding it again moves it.
+enum VB_EventId {
+  VB_Event_TIMER,
+  VB_Event_VIP,
+  VB_Event_VSU,
+  VB_Event_MAX,
+};
+
+struct VB_Event {
+  uint64_t when; // cycle that this is due on
+  uint8_t id; // VB_EventId
+};
+
+// min-heap of pending events, see scheduler.c
+struct VB_Scheduler {
+  struct VB_Event heap[VB_Event_MAX];
+  uint8_t count;
+  // where each event is in the heap (+1), 0 = not pending.
+  uint8_t slot[VB_Event_MAX];
+
+  // the cpu runs until this cycle, then the due events are fired.
+  uint64_t slice_end;
+  // the cycle that the current vb_run_cycles() finishes on.
+  uint64_t target;
+};
+
 struct VB_Core {
   struct VB_Cpu v810;
+  struct VB_LazyFlags flags;
   struct VB_Vip vip;
   struct VB_Vsu vsu;
   struct VB_Timer timer;
@@ -336,7 +570,59 @@ struct VB_Core {
 
   const uint8_t* rom;
   size_t rom_size;
-  uint32_t rom_mask; // unused (remove?)
+  uint32_t rom_mask;
+  // see vb_get_rom_hash(), 0 = not worked out yet.
+  uint64_t rom_hash;
+
+  // host memory behind each page of the bus, see vb_bus_map().
+  // NULL means the page has to go through the handlers.
+  const uint8_t* read_pages[VB_PAGE_COUNT];
+  uint8_t* write_pages[VB_PAGE_COUNT];
+  // wait states for each access to each region of the bus (addr >> 24),
+  // see vb_bus_update_waits().
+  uint8_t waits[8][VB_Access_MAX];
+
+  // rom instructions decoded on first execute, see fetch() in v810.c
+  struct VB_DecodedOp predecode[VB_PREDECODE_ENTRIES];
+
+  // blocks built from rom and wram, see vb_v810_run() in v810.c
+  struct VB_Block blocks[VB_BLOCK_ENTRIES];
+  // set for each page of wram that at least one block was built from.
+  bool wram_code[VB_WRAM_CODE_PAGES];
+
+  struct VB_Jit jit;
+
+  // this isn't saved, a state is loaded with the cache empty.
+  struct VB_ICache icache;
+  struct VB_VipCache vip_cache;
+  // draws the right eye while the left is drawn, see vb_set_vip_threads().
+  struct VB_VipWorker* vip_worker;
+
+  // VB_AnalysisMode, this is set by the frontend and kept across roms.
+  uint8_t analysis_mode;
+  struct VB_Analysis* analysis;
+  // it has finished (or is still going), but the cpu hasn't taken
+  // what it found yet, see vb_analysis_apply().
+  bool analysis_pending;
+
+  struct VB_IdleLoop idle_loops[VB_IDLE_LOOP_MAX];
+  uint8_t idle_loop_count;
+  // how many times each VB_Fusion has been run.
+  uint64_t fusion_hits[VB_Fusion_MAX];
+  // set by reads whose value changes with time, rather than only on an
+  // event (eg, the timer counter), a loop doing one of these isn't idle.
+  bool timed_read;
+
+  // a bit for each VB_Irq being raised, and whether the cpu can take
+  // one of them right now. these are rebuilt from the sources on load.
+  uint8_t irq_pending;
+  bool irq_ready;
+
+  struct VB_Scheduler sched;
+
+  // cycles left for the cpu to run until sched.slice_end.
+  // this goes negative if the cpu runs over, see vb_now().
+  int32_t cycles_left;
 
   uint16_t* pixels; // todo: support custom width
   uint32_t stride;
@@ -360,14 +646,33 @@ struct VB_State {
   struct VB_Pak pak;
 
   uint8_t wram[1024 * 64]; // 64 KiB
+
+  uint64_t clock; // vb_now() when the state was saved
 };
 
 enum VB_StateMeta {
   VB_StateMeta_MAGIC = 0x52454431, // RED1
-  VB_StateMeta_VERSION = 1,
+  VB_StateMeta_VERSION = 3,
   VB_StateMeta_SIZE = sizeof(struct VB_State),
 };
 
+// what vb_savecache() writes, followed by block_count rom addresses.
+// only where the blocks start is kept, the ops (and jit code) point into
+// this run's memory, so they're decoded / compiled again from the rom.
+struct VB_CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t rom_hash; // vb_get_rom_hash() of the rom it was made from
+  uint64_t checksum; // of the header (with this as 0) and the blocks
+  uint32_t block_count;
+  uint32_t reserved;
+};
+
+enum VB_CacheMeta {
+  VB_CacheMeta_MAGIC = 0x52454443, // REDC
+  VB_CacheMeta_VERSION = 1,
+};
+
 #ifdef __cplusplus
 }
 #endif
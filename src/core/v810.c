@@ -6,9 +6,11 @@
 #include "vb.h"
 #include "internal.h"
 #include "bit.h"
+#include "v810_ops.h"
 
 // #include <stdio.h>
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -69,387 +71,362 @@ static uint32_t align_32(const uint32_t v) { return v & ~(0x3); }
 #define WRITE32(addr, value) vb_bus_write_32(vb, align_32(addr), value)
 
 
-/* helper for v-flag calcs, ONLY used for add / sub (mults are different!) */
-static inline bool calc_v_flag_add_sub(
-  const uint32_t a, const uint32_t b, const uint32_t r
-) {
-  return (bit_is_set(31, a) == bit_is_set(31, b)) && (bit_is_set(31, a) != bit_is_set(31, r));
+// what the access costs on top of the instruction, see vb_bus_update_waits().
+static inline uint32_t wait_states(const struct VB_Core* vb, uint32_t addr, enum VB_Access access) {
+  return vb->waits[(addr >> 24) & 0x7][access];
 }
 
+static inline void add_wait_states(struct VB_Core* vb, uint32_t addr, enum VB_Access access) {
+  vb->cycles_left -= wait_states(vb, addr, access);
+}
 
-/* There are 6 unique formats for instruction encoding */
-/* 1-6 have been implemeted, format7 is basically identical to format1. */
-struct Format1 {
-  uint8_t reg1;   // 5-bits
-  uint8_t reg2;   // 5-bits
-};
-
-struct Format2 {
-  uint8_t lo5;    // 5-bits
-  uint8_t reg2;   // 5-bits
-};
-
-struct Format3 {
-  uint8_t cond;   // 4-bits
-  int32_t disp;   // TODO: this gets sign extended (16 or 32?)
-};
-
-struct Format4 {
-  int32_t disp;   // sign extended
-};
-
-struct Format5 {
-  uint8_t reg1;   // 5-bits
-  uint8_t reg2;   // 5-bits
-  uint16_t imm;   // fetched
-};
 
-struct Format6 {
-  uint8_t reg1;   // 5-bits
-  uint8_t reg2;   // 5-bits
-  int32_t disp;   // TODO: this gets sign extended (16 or 32?)
-};
+// [Flags]
+// most alu ops set the flags, but nearly all of them are overwritten by the
+// next one before anything looks at them. so rather than working out all 4
+// flags each time, what they would be is recorded in vb->flags, and only
+// turned into the psw bits when something reads them, see flags_sync().
+//
+// the carry is kept as a compare (carry_a < carry_b) so add / sub don't
+// have to work it out either, and logic ops (which leave CY alone) don't
+// have to touch it at all.
+//
+// anything that writes the psw flags directly has to call flags_load()
+// afterwards, so that a logic op after it carries on from the psw CY.
 
-struct Format7 {
-  uint8_t reg1;   // 5-bits
-  uint8_t reg2;   // 5-bits
-  uint8_t subop;  // 6-bits
-};
+static inline void flags_sync(struct VB_Core* vb) {
+  if (VB_LIKELY(!vb->flags.pending)) {
+    return;
+  }
 
-// [DEBUG]
-#if 0
-static void log_format1(const struct VB_Core* vb, const struct Format1 f) {
-  VB_UNUSED(vb);
+  FLAG_Z = vb->flags.result == 0;
+  FLAG_S = bit_is_set(31, vb->flags.result);
+  FLAG_OV = bit_is_set(31, vb->flags.overflow);
+  FLAG_CY = vb->flags.carry_a < vb->flags.carry_b;
+  vb->flags.pending = false;
+}
 
-  vb_log("OPCODE: 0x%02X\treg2-idx: %u\treg2: 0x%08X\treg1-idx: %u\treg1: 0x%08X\n\n",
-    f.opcode, f.reg2, REGISTERS[f.reg2], f.reg1, REGISTERS[f.reg1]);
+static inline void flags_load(struct VB_Core* vb) {
+  vb->flags.carry_a = 0;
+  vb->flags.carry_b = FLAG_CY;
+  vb->flags.pending = false;
 }
 
-static void log_format2(const struct VB_Core* vb, const struct Format2 f) {
-  VB_UNUSED(vb);
+static inline void flags_add(struct VB_Core* vb, uint32_t a, uint32_t b, uint32_t result) {
+  vb->flags.result = result;
+  vb->flags.overflow = ~(a ^ b) & (a ^ result);
+  vb->flags.carry_a = result;
+  vb->flags.carry_b = a;
+  vb->flags.pending = true;
+}
 
-  vb_log("OPCODE: 0x%02X\treg2-idx: %u\treg2: 0x%08X\tlo5: %u\n\n",
-    f.opcode, f.reg2, REGISTERS[f.reg2], f.lo5);
+static inline void flags_sub(struct VB_Core* vb, uint32_t a, uint32_t b, uint32_t result) {
+  vb->flags.result = result;
+  vb->flags.overflow = (a ^ b) & (a ^ result);
+  vb->flags.carry_a = a;
+  vb->flags.carry_b = b;
+  vb->flags.pending = true;
 }
 
-static void log_format3(const struct VB_Core* vb, const struct Format3 f) {
-  VB_UNUSED(vb);
+// Z and S from the result, OV cleared and CY left as it was.
+static inline void flags_logic(struct VB_Core* vb, uint32_t result) {
+  vb->flags.result = result;
+  vb->flags.overflow = 0;
+  vb->flags.pending = true;
+}
 
-  vb_log("OPCODE: 0x%02X\tcond: 0x%X\tdisp: %d\n\n",
-    f.opcode, f.cond, f.disp);
+static inline void flags_shift(struct VB_Core* vb, uint32_t result, bool carry) {
+  flags_logic(vb, result);
+  vb->flags.carry_a = 0;
+  vb->flags.carry_b = carry;
 }
 
-static void log_format4(const struct VB_Core* vb, const struct Format4 f) {
-  VB_UNUSED(vb);
+void vb_v810_sync_flags(struct VB_Core* vb) {
+  flags_sync(vb);
+}
 
-  vb_log("OPCODE: 0x%02X\tdisp: %d\n\n",
-    f.opcode, f.disp);
+void vb_v810_load_flags(struct VB_Core* vb) {
+  flags_load(vb);
 }
 
-static void log_format5(const struct VB_Core* vb, const struct Format5 f) {
-  VB_UNUSED(vb);
 
-  vb_log("OPCODE: 0x%02X\treg2-idx: %u\treg2: 0x%08X\treg1-idx: %u\treg1: 0x%08X; imm: 0x%X\n\n",
-    f.opcode, f.reg2, REGISTERS[f.reg2], f.reg1, REGISTERS[f.reg1], f.imm);
-}
+/* There are 7 unique formats for instruction encoding. */
+/* rather than re-parsing the format every time an instruction is executed, */
+/* each instruction is decoded once into a VB_DecodedOp, with the imm / disp */
+/* already extended in whichever way that instruction wants it. */
 
-static void log_format6(const struct VB_Core* vb, const struct Format6 f) {
+// [DEBUG]
+#if 0
+static void log_decoded_op(const struct VB_Core* vb, const struct VB_DecodedOp* op) {
   VB_UNUSED(vb);
 
-  vb_log("OPCODE: 0x%02X\treg2-idx: %u\treg2: 0x%08X\treg1-idx: %u\treg1: 0x%08X\tdisp: %d\n\n",
-    f.opcode, f.reg2, REGISTERS[f.reg2], f.reg1, REGISTERS[f.reg1], f.disp);
+  vb_log("reg2-idx: %u\treg2: 0x%08X\treg1-idx: %u\treg1: 0x%08X\timm: 0x%X\tsub: 0x%X\n\n",
+    op->reg2, REGISTERS[op->reg2], op->reg1, REGISTERS[op->reg1], op->imm, op->sub);
 }
 #else
-#define log_format1(vb, f)
-#define log_format2(vb, f)
-#define log_format3(vb, f)
-#define log_format4(vb, f)
-#define log_format5(vb, f)
-#define log_format6(vb, f)
-#define log_format7(vb, f)
+#define log_decoded_op(vb, op)
 #endif
 
 
 // [GEN]
-static inline struct Format1 gen_format1(struct VB_Core* vb, uint16_t op) {
-  const struct Format1 f = {
-    .reg1 = bit_get_range(0, 4, op),
-    .reg2 = bit_get_range(5, 9, op),
-  };
+static inline void gen_format1(struct VB_DecodedOp* op, uint16_t opcode) {
+  op->reg1 = bit_get_range(0, 4, opcode);
+  op->reg2 = bit_get_range(5, 9, opcode);
+}
 
-  log_format1(vb, f);
-  return f;
+// imm is the raw lo5 bits, used for shifts and system register indices.
+static inline void gen_format2(struct VB_DecodedOp* op, uint16_t opcode) {
+  op->imm = bit_get_range(0, 4, opcode);
+  op->reg2 = bit_get_range(5, 9, opcode);
 }
 
-static inline struct Format2 gen_format2(struct VB_Core* vb, uint16_t op) {
-  const struct Format2 f = {
-    .lo5 = bit_get_range(0, 4, op),
-    .reg2 = bit_get_range(5, 9, op),
-  };
+// imm is the lo5 bits sign extended, used for MOV / ADD / CMP.
+static inline void gen_format2_signed(struct VB_DecodedOp* op, uint16_t opcode) {
+  const uint32_t lo5 = bit_get_range(0, 4, opcode);
 
-  log_format2(vb, f);
-  return f;
+  op->imm = bit_sign_extend(4, lo5);
+  op->reg2 = bit_get_range(5, 9, opcode);
 }
 
-static inline struct Format3 gen_format3(struct VB_Core* vb, uint16_t op) {
-  const uint32_t disp_range = bit_get_range(0, 8, op);
-
-  const struct Format3 f = {
-    .cond = bit_get_range(9, 12, op),
-    .disp = bit_sign_extend(8, disp_range),
-  };
+static inline void gen_format3(struct VB_DecodedOp* op, uint16_t opcode) {
+  const uint32_t disp_range = bit_get_range(0, 8, opcode);
 
-  log_format3(vb, f);
-  return f;
+  op->sub = bit_get_range(9, 12, opcode);
+  op->imm = bit_sign_extend(8, disp_range);
 }
 
-static inline struct Format4 gen_format4(struct VB_Core* vb, uint16_t op) {
-  const uint16_t lo_disp = READ16(REG_PC);
-  const uint32_t hi_disp = bit_get_range(0, 9, op);
+// the 32-bit formats are given the second halfword as next.
+static inline void gen_format4(struct VB_DecodedOp* op, uint16_t opcode, uint16_t next) {
+  const uint16_t lo_disp = next;
+  const uint32_t hi_disp = bit_get_range(0, 9, opcode);
   const uint32_t disp = (hi_disp << 16) | lo_disp;
-  REG_PC += 2;
 
-  const struct Format4 f = {
-    .disp = bit_sign_extend(25, disp),
-  };
-
-  log_format4(vb, f);
-  return f;
+  op->imm = bit_sign_extend(25, disp);
+  op->size = 4;
 }
 
-static inline struct Format5 gen_format5(struct VB_Core* vb, uint16_t op) {
-  const uint16_t imm = READ16(REG_PC);
-  REG_PC += 2;
-
-  const struct Format5 f = {
-    .reg1 = bit_get_range(0, 4, op),
-    .reg2 = bit_get_range(5, 9, op),
-    .imm = imm,
-  };
-
-  log_format5(vb, f);
-  return f;
+// imm is zero extended, used for ANDI / ORI / XORI (and MOVHI).
+static inline void gen_format5(struct VB_DecodedOp* op, uint16_t opcode, uint16_t next) {
+  op->reg1 = bit_get_range(0, 4, opcode);
+  op->reg2 = bit_get_range(5, 9, opcode);
+  op->imm = next;
+  op->size = 4;
 }
 
-static inline struct Format6 gen_format6(struct VB_Core* vb, uint16_t op) {
-  const uint16_t disp = READ16(REG_PC);
-  REG_PC += 2;
+// imm is sign extended, used for MOVEA / ADDI.
+static inline void gen_format5_signed(struct VB_DecodedOp* op, uint16_t opcode, uint16_t next) {
+  gen_format5(op, opcode, next);
+  op->imm = (int32_t)(int16_t)op->imm;
+}
 
-  const struct Format6 f = {
-    .reg1 = bit_get_range(0, 4, op),
-    .reg2 = bit_get_range(5, 9, op),
-    .disp = bit_sign_extend(15, disp),
-  };
+static inline void gen_format6(struct VB_DecodedOp* op, uint16_t opcode, uint16_t next) {
+  const uint16_t disp = next;
 
-  return f;
+  op->reg1 = bit_get_range(0, 4, opcode);
+  op->reg2 = bit_get_range(5, 9, opcode);
+  op->imm = bit_sign_extend(15, disp);
+  op->size = 4;
 }
 
-static inline struct Format7 gen_format7(struct VB_Core* vb, uint16_t op) {
+static inline void gen_format7(struct VB_DecodedOp* op, uint16_t opcode, uint16_t next) {
   // note: i am unsure if this is correct.
   // format7 is listed as fetching a 32bit value, but most
   // of that value is RFU.
   // this fetch would mean the pc advances by 4...
-  const uint16_t next_op = READ16(REG_PC);
-  REG_PC += 2;
-
-  const struct Format7 f = {
-    .reg1 = bit_get_range(0, 4, op),
-    .reg2 = bit_get_range(5, 9, op),
-    // .subop = bit_get_range(5, 9, next_op),
-    .subop = (next_op >> 10) & 0x3F,
-  };
+  const uint16_t next_op = next;
 
-  log_format7(vb, f);
-  return f;
+  op->reg1 = bit_get_range(0, 4, opcode);
+  op->reg2 = bit_get_range(5, 9, opcode);
+  op->sub = (next_op >> 10) & 0x3F;
+  op->size = 4;
 }
 
 // [Register Transfer]
-static inline void MOV_imm(struct VB_Core* vb, struct Format2 f) {
-  REGISTERS[f.reg2] = bit_sign_extend(4, f.lo5);
+static void MOV_imm(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = op->imm;
 }
 
-static inline void MOV_reg(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = REGISTERS[f.reg1];
+static void MOV_reg(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = REGISTERS[op->reg1];
 }
 
-static inline void MOVEA(struct VB_Core* vb, struct Format5 f) {
-  // const int32_t imm = bit_sign_extend(15, f.imm);
-  const int32_t imm = (int32_t)(int16_t)f.imm;
-  REGISTERS[f.reg2] = REGISTERS[f.reg1] + imm;
+static void MOVEA(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = REGISTERS[op->reg1] + op->imm;
 }
 
-static inline void MOVHI(struct VB_Core* vb, struct Format5 f) {
-  const uint32_t imm = (uint32_t)f.imm << 16;
-  REGISTERS[f.reg2] = REGISTERS[f.reg1] + imm;
+static void MOVHI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  // imm is already shifted into the upper half by the decoder.
+  REGISTERS[op->reg2] = REGISTERS[op->reg1] + op->imm;
 }
 
 
 // [Load and Input]
-static inline void IN_B(struct VB_Core* vb, struct Format6 f) {
+static void IN_B(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // read byte from port
-  REGISTERS[f.reg2] = READ8(REGISTERS[f.reg1] + f.disp);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_8);
+  REGISTERS[op->reg2] = READ8(addr);
 }
 
-static inline void IN_H(struct VB_Core* vb, struct Format6 f) {
+static void IN_H(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // read halfword from port
-  REGISTERS[f.reg2] = READ16(REGISTERS[f.reg1] + f.disp);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_16);
+  REGISTERS[op->reg2] = READ16(addr);
 }
 
-static inline void IN_W(struct VB_Core* vb, struct Format6 f) {
+static void IN_W(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // read word from port
-  REGISTERS[f.reg2] = READ32(REGISTERS[f.reg1] + f.disp);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_32);
+  REGISTERS[op->reg2] = READ32(addr);
 }
 
-static inline void LD_B(struct VB_Core* vb, struct Format6 f) {
+static void LD_B(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // read byte from port and sign_extend
-  // const uint8_t value = READ8(REGISTERS[f.reg1] + f.disp);
+  // const uint8_t value = READ8(REGISTERS[op->reg1] + op->imm);
   // const int32_t extended = bit_sign_extend(8-1, value);
-  // REGISTERS[f.reg2] = extended;
+  // REGISTERS[op->reg2] = extended;
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_8);
 
-  REGISTERS[f.reg2] = (int32_t)(int8_t)READ8(REGISTERS[f.reg1] + f.disp);
+  REGISTERS[op->reg2] = (int32_t)(int8_t)READ8(addr);
 }
 
-static inline void LD_H(struct VB_Core* vb, struct Format6 f) {
+static void LD_H(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // read halfword from port and sign_extend
-  // const uint16_t value = READ16(REGISTERS[f.reg1] + f.disp);
+  // const uint16_t value = READ16(REGISTERS[op->reg1] + op->imm);
   // const int32_t extended = bit_sign_extend(16-1, value);
-  // REGISTERS[f.reg2] = extended;
+  // REGISTERS[op->reg2] = extended;
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_16);
 
-  REGISTERS[f.reg2] = (int32_t)(int16_t)READ16(REGISTERS[f.reg1] + f.disp);
+  REGISTERS[op->reg2] = (int32_t)(int16_t)READ16(addr);
 }
 
-static inline void LD_W(struct VB_Core* vb, struct Format6 f) {
+static void LD_W(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // read word from port (same as IN_W)
-  REGISTERS[f.reg2] = READ32(REGISTERS[f.reg1] + f.disp);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_32);
+  REGISTERS[op->reg2] = READ32(addr);
 }
 
 
 // [Store and Output]
-static inline void OUT_B(struct VB_Core* vb, struct Format6 f) {
+static void OUT_B(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // store byte
-  WRITE8(REGISTERS[f.reg1] + f.disp, REGISTERS[f.reg2]);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_8);
+  WRITE8(addr, REGISTERS[op->reg2]);
 }
 
-static inline void OUT_H(struct VB_Core* vb, struct Format6 f) {
+static void OUT_H(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // store halfword
-  WRITE16(REGISTERS[f.reg1] + f.disp, REGISTERS[f.reg2]);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_16);
+  WRITE16(addr, REGISTERS[op->reg2]);
 }
 
-static inline void OUT_W(struct VB_Core* vb, struct Format6 f) {
+static void OUT_W(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // store word
-  WRITE32(REGISTERS[f.reg1] + f.disp, REGISTERS[f.reg2]);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_32);
+  WRITE32(addr, REGISTERS[op->reg2]);
 }
 
-static inline void ST_B(struct VB_Core* vb, struct Format6 f) {
+static void ST_B(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // store byte
-  WRITE8(REGISTERS[f.reg1] + f.disp, REGISTERS[f.reg2]);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_8);
+  WRITE8(addr, REGISTERS[op->reg2]);
 }
 
-static inline void ST_H(struct VB_Core* vb, struct Format6 f) {
+static void ST_H(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // store halfword
-  WRITE16(REGISTERS[f.reg1] + f.disp, REGISTERS[f.reg2]);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_16);
+  WRITE16(addr, REGISTERS[op->reg2]);
 }
 
-static inline void ST_W(struct VB_Core* vb, struct Format6 f) {
+static void ST_W(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // store word
-  WRITE32(REGISTERS[f.reg1] + f.disp, REGISTERS[f.reg2]);
+  const uint32_t addr = REGISTERS[op->reg1] + op->imm;
+  add_wait_states(vb, addr, VB_Access_32);
+  WRITE32(addr, REGISTERS[op->reg2]);
 }
 
 
 // [Arithmetic]
 static inline uint32_t add_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
-  uint32_t result;
-
-  #if USE_BUILTIN && HAS_BUILTIN(__builtin_add_overflow)
-    FLAG_CY = __builtin_add_overflow(a, b, &result);
-  #else
-    result = a + b;
-    FLAG_CY = (uint64_t)a + (uint64_t)b > UINT32_MAX;
-  #endif
-
-  FLAG_Z = result == 0;
-  FLAG_S = bit_is_set(31, result);
-  FLAG_OV = calc_v_flag_add_sub(a, b, result);
-
+  const uint32_t result = a + b;
+  flags_add(vb, a, b, result);
   return result;
 }
 
-static inline void ADD_imm(struct VB_Core* vb, struct Format2 f) {
-  const int32_t imm = bit_sign_extend(4, f.lo5);
-  REGISTERS[f.reg2] = add_internal(vb, REGISTERS[f.reg2], imm);
+static void ADD_imm(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = add_internal(vb, REGISTERS[op->reg2], op->imm);
 }
 
-static inline void ADD_reg(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = add_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void ADD_reg(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = add_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void ADDI(struct VB_Core* vb, struct Format5 f) {
-  const int32_t imm = bit_sign_extend(15, f.imm);
-  REGISTERS[f.reg2] = add_internal(vb, REGISTERS[f.reg2], imm);
+static void ADDI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = add_internal(vb, REGISTERS[op->reg2], op->imm);
 }
 
 static inline uint32_t sub_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
-  uint32_t result;
-
-  #if USE_BUILTIN && HAS_BUILTIN(__builtin_sub_overflow)
-    FLAG_CY = __builtin_sub_overflow(a, b, &result);
-  #else
-    result = a - b;
-    FLAG_CY = b > a;
-  #endif
-
-  FLAG_Z = result == 0;
-  FLAG_S = bit_is_set(31, result);
-  FLAG_OV = calc_v_flag_add_sub(a, ~b, result);
-
+  const uint32_t result = a - b;
+  flags_sub(vb, a, b, result);
   return result;
 }
 
-static inline void CMP_imm(struct VB_Core* vb, struct Format2 f) {
-  const uint32_t imm = bit_sign_extend(4, f.lo5);
-  sub_internal(vb, REGISTERS[f.reg2], imm);
+static void CMP_imm(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  sub_internal(vb, REGISTERS[op->reg2], op->imm);
 }
 
-static inline void CMP_reg(struct VB_Core* vb, struct Format1 f) {
-  sub_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void CMP_reg(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  sub_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void SUB_reg(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = sub_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void SUB_reg(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = sub_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void MUL(struct VB_Core* vb, struct Format1 f) {
+static void MUL(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // signed mul
   assert(0);
-  const int64_t result = (int64_t)(int32_t)REGISTERS[f.reg2] * (int64_t)(int32_t)REGISTERS[f.reg1];
+  const int64_t result = (int64_t)(int32_t)REGISTERS[op->reg2] * (int64_t)(int32_t)REGISTERS[op->reg1];
 
+  flags_sync(vb);
   FLAG_Z = result == 0;
   FLAG_S = result < 0;
   FLAG_OV = (uint64_t)result != (uint32_t)result;
+  flags_load(vb);
 
   REGISTERS[30] = result >> 32; // upper half
-  REGISTERS[f.reg2] = result; // lower half
+  REGISTERS[op->reg2] = result; // lower half
 }
 
-static inline void MULU(struct VB_Core* vb, struct Format1 f) {
+static void MULU(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // unsigned mul
   assert(0);
-  const uint64_t result = (uint64_t)REGISTERS[f.reg2] * (uint64_t)REGISTERS[f.reg1];
+  const uint64_t result = (uint64_t)REGISTERS[op->reg2] * (uint64_t)REGISTERS[op->reg1];
 
+  flags_sync(vb);
   FLAG_Z = result == 0;
   FLAG_S = (result >> 63) & 1;
   FLAG_OV = (uint64_t)result != (uint32_t)result;
+  flags_load(vb);
 
   REGISTERS[30] = result >> 32; // upper half
-  REGISTERS[f.reg2] = result; // lower half
+  REGISTERS[op->reg2] = result; // lower half
 }
 
 
 // [Bitwise]
 static inline void set_bitwise_flags(struct VB_Core* vb, uint32_t result) {
-  FLAG_Z = result == 0;
-  FLAG_S = bit_is_set(31, result);
-  FLAG_OV = 0;
+  flags_logic(vb, result);
 }
 
 static inline uint32_t and_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
@@ -458,18 +435,18 @@ static inline uint32_t and_internal(struct VB_Core* vb, uint32_t a, uint32_t b)
   return result;
 }
 
-static inline void AND(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = and_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void AND(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = and_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void ANDI(struct VB_Core* vb, struct Format5 f) {
-  REGISTERS[f.reg2] = and_internal(vb, REGISTERS[f.reg1], f.imm);
+static void ANDI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = and_internal(vb, REGISTERS[op->reg1], op->imm);
 }
 
-static inline void NOT(struct VB_Core* vb, struct Format1 f) {
-  const uint32_t result = ~REGISTERS[f.reg1];
+static void NOT(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t result = ~REGISTERS[op->reg1];
   set_bitwise_flags(vb, result);
-  REGISTERS[f.reg2] = result;
+  REGISTERS[op->reg2] = result;
 }
 
 static inline uint32_t or_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
@@ -478,66 +455,63 @@ static inline uint32_t or_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
   return result;
 }
 
-static inline void OR(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = or_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void OR(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = or_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void ORI(struct VB_Core* vb, struct Format5 f) {
-  REGISTERS[f.reg2] = or_internal(vb, REGISTERS[f.reg1], f.imm);
+static void ORI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = or_internal(vb, REGISTERS[op->reg1], op->imm);
 }
 
 static inline uint32_t sar_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
   const uint8_t shift_v = (b & 0x1F);
   const uint32_t result = (int32_t)a >> shift_v;
 
-  set_bitwise_flags(vb, result);
-  FLAG_CY = shift_v == 0 ? 0 : bit_is_set(shift_v - 1, result);
+  flags_shift(vb, result, shift_v == 0 ? 0 : bit_is_set(shift_v - 1, result));
 
   return result;
 }
 
-static inline void SAR(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = sar_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void SAR(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = sar_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void SARI(struct VB_Core* vb, struct Format2 f) {
-  REGISTERS[f.reg2] = sar_internal(vb, REGISTERS[f.reg2], f.lo5);
+static void SARI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = sar_internal(vb, REGISTERS[op->reg2], op->imm);
 }
 
 static inline uint32_t shl_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
   const uint8_t shift_v = (b & 0x1F);
   const uint32_t result = a << shift_v;
 
-  set_bitwise_flags(vb, result);
-  FLAG_CY = shift_v == 0 ? 0 : bit_is_set(32 - shift_v, result);
+  flags_shift(vb, result, shift_v == 0 ? 0 : bit_is_set(32 - shift_v, result));
 
   return result;
 }
 
-static inline void SHL(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = shl_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void SHL(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = shl_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void SHLI(struct VB_Core* vb, struct Format2 f) {
-  REGISTERS[f.reg2] = shl_internal(vb, REGISTERS[f.reg2], f.lo5);
+static void SHLI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = shl_internal(vb, REGISTERS[op->reg2], op->imm);
 }
 
 static inline uint32_t shr_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
   const uint8_t shift_v = (b & 0x1F);
   const uint32_t result = a >> shift_v;
 
-  set_bitwise_flags(vb, result);
-  FLAG_CY = shift_v == 0 ? 0 : bit_is_set(shift_v - 1, result);
+  flags_shift(vb, result, shift_v == 0 ? 0 : bit_is_set(shift_v - 1, result));
 
   return result;
 }
 
-static inline void SHR(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = shr_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void SHR(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = shr_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
 }
 
-static inline void SHRI(struct VB_Core* vb, struct Format2 f) {
-  REGISTERS[f.reg2] = shr_internal(vb, REGISTERS[f.reg2], f.lo5);
+static void SHRI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = shr_internal(vb, REGISTERS[op->reg2], op->imm);
 }
 
 static inline uint32_t xor_internal(struct VB_Core* vb, uint32_t a, uint32_t b) {
@@ -546,137 +520,350 @@ static inline uint32_t xor_internal(struct VB_Core* vb, uint32_t a, uint32_t b)
   return result;
 }
 
-static inline void XOR(struct VB_Core* vb, struct Format1 f) {
-  REGISTERS[f.reg2] = xor_internal(vb, REGISTERS[f.reg2], REGISTERS[f.reg1]);
+static void XOR(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = xor_internal(vb, REGISTERS[op->reg2], REGISTERS[op->reg1]);
+}
+
+static void XORI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[op->reg2] = xor_internal(vb, REGISTERS[op->reg1], op->imm);
+}
+
+
+// [Interrupts]
+// each source (see VB_Irq) sets its bit in vb->irq_pending while it wants
+// an interrupt, and whether one can be taken right now is only worked out
+// when that or the psw changes, see irq_update(). the cpu only checks
+// vb->irq_ready between blocks, so nothing is added per instruction.
+
+static uint32_t psw_read(struct VB_Core* vb) {
+  flags_sync(vb);
+
+  uint32_t result = 0;
+  result |= CPU.PSW.Z << 0;
+  result |= CPU.PSW.S << 1;
+  result |= CPU.PSW.OV << 2;
+  result |= CPU.PSW.CY << 3;
+  result |= CPU.PSW.FPR << 4;
+  result |= CPU.PSW.FUD << 5;
+  result |= CPU.PSW.FOV << 6;
+  result |= CPU.PSW.FZD << 7;
+  result |= CPU.PSW.FIV << 8;
+  result |= CPU.PSW.FRO << 9;
+  result |= CPU.PSW.ID << 12;
+  result |= CPU.PSW.AE << 13;
+  result |= CPU.PSW.EP << 14;
+  result |= CPU.PSW.NP << 15;
+  result |= (uint32_t)CPU.PSW.I << 16;
+  return result;
+}
+
+// the highest level wins, 4 (vip) down to 0 (pad).
+static inline uint8_t irq_highest(uint8_t pending) {
+  uint8_t level = VB_Irq_MAX - 1;
+
+  while (level && !(pending & (1 << level))) {
+    level--;
+  }
+
+  return level;
+}
+
+static void irq_update(struct VB_Core* vb) {
+  // no interrupts while handling one, or an exception.
+  if (!vb->irq_pending || CPU.PSW.ID || CPU.PSW.EP || CPU.PSW.NP) {
+    vb->irq_ready = false;
+    return;
+  }
+
+  vb->irq_ready = irq_highest(vb->irq_pending) >= CPU.PSW.I;
+}
+
+static void psw_write(struct VB_Core* vb, uint32_t value) {
+  CPU.PSW.Z = bit_is_set(0, value);
+  CPU.PSW.S = bit_is_set(1, value);
+  CPU.PSW.OV = bit_is_set(2, value);
+  CPU.PSW.CY = bit_is_set(3, value);
+  CPU.PSW.FPR = bit_is_set(4, value);
+  CPU.PSW.FUD = bit_is_set(5, value);
+  CPU.PSW.FOV = bit_is_set(6, value);
+  CPU.PSW.FZD = bit_is_set(7, value);
+  CPU.PSW.FIV = bit_is_set(8, value);
+  CPU.PSW.FRO = bit_is_set(9, value);
+  CPU.PSW.ID = bit_is_set(12, value);
+  CPU.PSW.AE = bit_is_set(13, value);
+  CPU.PSW.EP = bit_is_set(14, value);
+  CPU.PSW.NP = bit_is_set(15, value);
+  CPU.PSW.I = bit_get_range(16, 19, value);
+  flags_load(vb);
+  irq_update(vb);
+}
+
+void vb_irq_set(struct VB_Core* vb, enum VB_Irq irq, bool asserted) {
+  const uint8_t pending = asserted ? (vb->irq_pending | (1 << irq)) : (vb->irq_pending & ~(1 << irq));
+
+  if (pending != vb->irq_pending) {
+    vb->irq_pending = pending;
+    irq_update(vb);
+  }
+}
+
+void vb_v810_update_irq(struct VB_Core* vb) {
+  irq_update(vb);
+}
+
+// code goes into ECR, the cpu then jumps to handler, and RETI returns to
+// return_pc. an exception while already handling one is a duplexed
+// exception, which uses FEPC / FEPSW, and one more than that is fatal.
+static void enter_exception(struct VB_Core* vb, uint16_t code, uint32_t handler, uint32_t return_pc) {
+  const uint32_t psw = psw_read(vb);
+
+  if (VB_UNLIKELY(CPU.PSW.NP)) {
+    vb_log_fatal("[CPU] fatal exception: 0x%04X pc: 0x%08X\n", code, return_pc);
+    return;
+  }
+
+  if (CPU.PSW.EP) {
+    CPU.FEPC = return_pc;
+    CPU.FEPSW = psw;
+    CPU.ECR.FECC = code;
+    CPU.PSW.NP = true;
+    handler = 0xFFFFFFD0;
+  }
+  else {
+    CPU.EIPC = return_pc;
+    CPU.EIPSW = psw;
+    CPU.ECR.EICC = code;
+    CPU.PSW.EP = true;
+  }
+
+  CPU.PSW.ID = true;
+  CPU.PSW.AE = false;
+  REG_PC = handler;
+  irq_update(vb);
+}
+
+// only called between blocks, when vb->irq_ready is set.
+static void take_interrupt(struct VB_Core* vb) {
+  const uint8_t level = irq_highest(vb->irq_pending);
+
+  // halt leaves the pc on the next instruction, so that's where it returns.
+  CPU.halted = false;
+  enter_exception(vb, 0xFE00 | (level << 4), 0xFFFFFE00 | (level << 4), REG_PC);
+  CPU.PSW.I = VB_MIN(level + 1, 15);
+}
+
+
+// [Cache]
+// the v810 has a 1 KiB direct mapped instruction cache, 128 lines of 2
+// words, each word with its own valid bit and a tag shared by the line.
+// code is still run from memory, this only works out what fetching it
+// costs: nothing on a hit, reading the word on a miss.
+//
+// each word keeps the address it holds | 1, so a hit is one compare.
+// blocks look up every word they span once on entry, see vb_v810_run().
+
+enum {
+  CHCW_ICC = 1 << 0, // clear CEC lines from CEN
+  CHCW_ICE = 1 << 1, // enable
+  CHCW_ICD = 1 << 4, // dump to SA
+  CHCW_ICR = 1 << 5, // restore from SA
+};
+
+static VB_FORCE_INLINE void cache_fetch(struct VB_Core* vb, uint32_t word) {
+  struct VB_ICache* cache = &vb->icache;
+  const uint32_t index = (word >> 2) & (VB_ICACHE_WORDS - 1);
+
+  if (VB_LIKELY(cache->tags[index] == (word | 1))) {
+    cache->hits++;
+    return;
+  }
+
+  // the line has one tag, so the other word goes if it was for another one.
+  if ((cache->tags[index ^ 1] ^ word) >> 10) {
+    cache->tags[index ^ 1] = 0;
+  }
+
+  cache->tags[index] = word | 1;
+  cache->misses++;
+  vb->cycles_left -= wait_states(vb, word, VB_Access_32);
+}
+
+static void cache_fetch_range(struct VB_Core* vb, uint32_t start, uint32_t end) {
+  for (uint32_t word = align_32(start); word < end; word += 4) {
+    cache_fetch(vb, word);
+  }
+}
+
+static void cache_clear(struct VB_Core* vb, uint32_t first, uint32_t count) {
+  for (uint32_t line = first; line < first + count && line < VB_ICACHE_LINES; line++) {
+    vb->icache.tags[line * 2 + 0] = 0;
+    vb->icache.tags[line * 2 + 1] = 0;
+  }
+}
+
+// the data of each line goes first (1 KiB), then a word per line of the
+// tag (bits 0-21) and the valid bits (22, 23). the data isn't kept, so
+// it's read from where it was cached from.
+static void cache_dump(struct VB_Core* vb, uint32_t addr) {
+  for (uint32_t line = 0; line < VB_ICACHE_LINES; line++) {
+    uint32_t tag = 0;
+
+    for (uint32_t i = 0; i < 2; i++) {
+      const uint32_t word = vb->icache.tags[line * 2 + i];
+
+      if (word) {
+        WRITE32(addr + line * 8 + i * 4, READ32(word & ~1));
+        tag |= (word >> 10) | (1 << (22 + i));
+      }
+    }
+
+    WRITE32(addr + 1024 + line * 4, tag);
+  }
+}
+
+static void cache_restore(struct VB_Core* vb, uint32_t addr) {
+  for (uint32_t line = 0; line < VB_ICACHE_LINES; line++) {
+    const uint32_t tag = READ32(addr + 1024 + line * 4);
+
+    for (uint32_t i = 0; i < 2; i++) {
+      const uint32_t word = (tag << 10) | (line << 3) | (i << 2);
+      vb->icache.tags[line * 2 + i] = (tag & (1 << (22 + i))) ? (word | 1) : 0;
+    }
+  }
+}
+
+// only ICE sticks, the rest are commands, which are done in this order.
+static void cache_control(struct VB_Core* vb, uint32_t value) {
+  if (value & CHCW_ICC) {
+    cache_clear(vb, bit_get_range(20, 31, value), bit_get_range(8, 19, value));
+  }
+  else if (value & CHCW_ICD) {
+    cache_dump(vb, value & ~0xFF);
+  }
+  else if (value & CHCW_ICR) {
+    cache_restore(vb, value & ~0xFF);
+  }
+
+  CPU.CHCW = value & CHCW_ICE;
 }
 
-static inline void XORI(struct VB_Core* vb, struct Format5 f) {
-  REGISTERS[f.reg2] = xor_internal(vb, REGISTERS[f.reg1], f.imm);
+void vb_get_cache_stats(const struct VB_Core* vb, uint64_t* hits, uint64_t* misses) {
+  *hits = vb->icache.hits;
+  *misses = vb->icache.misses;
 }
 
 
 // [CPU Control]
-static inline void Bcond(struct VB_Core* vb, struct Format3 f) {
-  #define GOTO_IF(c) if (c) { goto take_branch; } break;
-
-  switch (f.cond & 15) {
-    case BV: GOTO_IF(FLAG_OV);
-    case BC: GOTO_IF(FLAG_CY);
-    case BE: GOTO_IF(FLAG_Z);
-    case BNH: GOTO_IF(FLAG_CY || FLAG_Z);
-    case BN: GOTO_IF(FLAG_S);
-    case BR: GOTO_IF(true);
-    case BLT: GOTO_IF(FLAG_OV != FLAG_S);
-    case BLE: GOTO_IF((FLAG_OV != FLAG_S) || FLAG_Z);
-    case BNV: GOTO_IF(!FLAG_OV);
-    case BNC: GOTO_IF(!FLAG_CY);
-    case BNE: GOTO_IF(!FLAG_Z);
-    case BH: GOTO_IF(!(FLAG_CY || FLAG_Z));
-    case BP: GOTO_IF(!FLAG_S);
-    case NOP: GOTO_IF(false);
-    case BGE: GOTO_IF(!(FLAG_OV != FLAG_S));
-    case BGT: GOTO_IF(!((FLAG_OV != FLAG_S) || FLAG_Z));
-  }
-
-  #undef GOTO_IF
-
-  /* no branch taken... */
-  vb_log("no jump with cond %u\n", f.cond);
-  return;
-
-take_branch:
-  vb_log("jump with cond %u disp %d\n", f.cond, f.disp);
+// shared by Bcond and SETF, which use the same conditions.
+static bool condition_met(struct VB_Core* vb, uint8_t cond) {
+  flags_sync(vb);
+
+  switch (cond & 15) {
+    case BV: return FLAG_OV;
+    case BC: return FLAG_CY;
+    case BE: return FLAG_Z;
+    case BNH: return FLAG_CY || FLAG_Z;
+    case BN: return FLAG_S;
+    case BR: return true;
+    case BLT: return FLAG_OV != FLAG_S;
+    case BLE: return (FLAG_OV != FLAG_S) || FLAG_Z;
+    case BNV: return !FLAG_OV;
+    case BNC: return !FLAG_CY;
+    case BNE: return !FLAG_Z;
+    case BH: return !(FLAG_CY || FLAG_Z);
+    case BP: return !FLAG_S;
+    case NOP: return false;
+    case BGE: return !(FLAG_OV != FLAG_S);
+    case BGT: return !((FLAG_OV != FLAG_S) || FLAG_Z);
+  }
+
+  return false;
+}
+
+static inline void branch_taken(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  vb_log("jump with cond %u disp %d\n", op->sub, op->imm);
+  vb->cycles_left -= 2; // taken branches take 3 cycles rather than 1
   // NOTE: the disp is applied to the original pc, before incrementing
   // after opcode fetch.
   // An example of this is in [Jack Bros] where is jumps with disp = -2.
   // the result of this should be the instruction before the Bcond instruction.
   // likely being a simple [while (FLAG) { value++; }] loop.
-  REG_PC =  (REG_PC - 2) + f.disp;
+  REG_PC =  (REG_PC - 2) + op->imm;
   REG_PC = align_16(REG_PC);
 }
 
-static inline void HALT(struct VB_Core* vb, struct Format2 f) {
-  VB_UNUSED(f);
-  assert(!"halt called!");
+static void Bcond(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  if (!condition_met(vb, op->sub)) {
+    /* no branch taken... */
+    vb_log("no jump with cond %u\n", op->sub);
+    return;
+  }
+
+  branch_taken(vb, op);
+}
+
+static void SETF(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  // set flag condition, reg2 = 1 if the condition is met, else 0
+  REGISTERS[op->reg2] = condition_met(vb, op->imm);
+}
+
+// the pc is left on the next instruction, which is where the interrupt
+// that wakes the cpu returns to. see vb_v810_run() for the waiting.
+static void HALT(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  VB_UNUSED(op);
   CPU.halted = true;
 }
 
-static inline void JAL(struct VB_Core* vb, struct Format4 f) {
+static void JAL(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // PC is already 4-bytes ahead due to opcode fetch and format4 disp fetch
   REGISTERS[LINK_POINTER] = REG_PC;
-  REG_PC = (REG_PC - 4) + f.disp;
+  REG_PC = (REG_PC - 4) + op->imm;
   REG_PC = align_16(REG_PC);
   vb_log("REG_PC %08X; LR: %08X\n", REG_PC, REGISTERS[LINK_POINTER]);
 }
 
-static inline void JMP(struct VB_Core* vb, struct Format1 f) {
-  REG_PC = REGISTERS[f.reg1];
+static void JMP(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REG_PC = REGISTERS[op->reg1];
   REG_PC = align_16(REG_PC);
 }
 
-static inline void JR(struct VB_Core* vb, struct Format4 f) {
+static void JR(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   // PC is already 4-bytes ahead due to opcode fetch and format4 disp fetch
-  REG_PC = (REG_PC - 4) + f.disp;
+  REG_PC = (REG_PC - 4) + op->imm;
   REG_PC = align_16(REG_PC);
 }
 
-static inline void LDSR(struct VB_Core* vb, struct Format2 f) {
-  const uint32_t value = REGISTERS[f.reg2];
+static void LDSR(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t value = REGISTERS[op->reg2];
 
-  switch (f.lo5 & 31) {
+  switch (op->imm & 31) {
     case ADTRE:
       vb_log_fatal("[ADTRE] unimpl write: 0x%08X\n", value);
       break;
 
     case CHCW:
-      printf("[CHCW] unimpl write: 0x%08X\n", value);
+      cache_control(vb, value);
       break;
 
     case ECR:
       assert(!"[ECR] cannot be modified by LDSR");
       break;
 
-    case EIPC:
-      vb_log_fatal("[EIPC] unimpl write: 0x%08X\n", value);
-      break;
-
-    case EIPSW:
-      vb_log_fatal("[EIPSW] unimpl write: 0x%08X\n", value);
-      break;
-
-    case FEPC:
-      vb_log_fatal("[FEPC] unimpl write: 0x%08X\n", value);
-      break;
-
-    case FEPSW:
-      vb_log_fatal("[FEPSW] unimpl write: 0x%08X\n", value);
-      break;
+    case EIPC: CPU.EIPC = align_16(value); break;
+    case EIPSW: CPU.EIPSW = value; break;
+    case FEPC: CPU.FEPC = align_16(value); break;
+    case FEPSW: CPU.FEPSW = value; break;
 
     case PIR:
-      vb_log_fatal("[PIR] unimpl write: 0x%08X\n", value);
+      // read only
       break;
 
     case PSW:
-      CPU.PSW.Z = bit_is_set(0, value);
-      CPU.PSW.S = bit_is_set(1, value);
-      CPU.PSW.OV = bit_is_set(2, value);
-      CPU.PSW.CY = bit_is_set(3, value);
-      CPU.PSW.FPR = bit_is_set(4, value);
-      CPU.PSW.FUD = bit_is_set(5, value);
-      CPU.PSW.FOV = bit_is_set(6, value);
-      CPU.PSW.FZD = bit_is_set(7, value);
-      CPU.PSW.FIV = bit_is_set(8, value);
-      CPU.PSW.FRO = bit_is_set(9, value);
-      CPU.PSW.ID = bit_is_set(12, value);
-      CPU.PSW.AE = bit_is_set(13, value);
-      CPU.PSW.EP = bit_is_set(14, value);
-      CPU.PSW.NP = bit_is_set(15, value);
-      CPU.PSW.I = bit_get_range(16, 19, value);
-      printf("[PSW] unimpl write: 0x%08X\n", value);
+      psw_write(vb, value);
       break;
 
     case TKCW:
-      vb_log_fatal("[TKCW] unimpl write: 0x%08X\n", value);
+      // read only
       break;
 
     case ABS:
@@ -685,68 +872,32 @@ static inline void LDSR(struct VB_Core* vb, struct Format2 f) {
       break;
 
     default:
-      vb_log_fatal("[unk] unimpl write: 0x%08X index: %u\n", value, f.lo5);
+      vb_log_fatal("[unk] unimpl write: 0x%08X index: %u\n", value, op->imm);
       break;
   }
 }
 
-static inline void STSR(struct VB_Core* vb, struct Format2 f) {
+static void STSR(struct VB_Core* vb, const struct VB_DecodedOp* op) {
   uint32_t result = 0;
 
-  switch (f.lo5 & 31) {
+  switch (op->imm & 31) {
     case ADTRE:
       vb_log_fatal("[ADTRE] unimpl read\n");
       break;
 
-    case CHCW:
-      vb_log_fatal("[CHCW] unimpl read\n");
-      break;
-
-    case ECR:
-      assert(!"[ECR] cannot be modified by LDSR");
-      break;
-
-    case EIPC:
-      vb_log_fatal("[EIPC] unimpl read\n");
-      break;
-
-    case EIPSW:
-      vb_log_fatal("[EIPSW] unimpl read\n");
-      break;
-
-    case FEPC:
-      vb_log_fatal("[FEPC] unimpl read\n");
-      break;
-
-    case FEPSW:
-      vb_log_fatal("[FEPSW] unimpl read\n");
-      break;
-
-    case PIR:
-      vb_log_fatal("[PIR] unimpl read\n");
-      break;
+    case CHCW: result = CPU.CHCW; break;
 
-    case PSW:
-      result |= CPU.PSW.Z << 0;
-      result |= CPU.PSW.S << 1;
-      result |= CPU.PSW.OV << 2;
-      result |= CPU.PSW.CY << 3;
-      result |= CPU.PSW.FPR << 4;
-      result |= CPU.PSW.FUD << 5;
-      result |= CPU.PSW.FOV << 6;
-      result |= CPU.PSW.FZD << 7;
-      result |= CPU.PSW.FIV << 8;
-      result |= CPU.PSW.FRO << 9;
-      result |= CPU.PSW.ID << 12;
-      result |= CPU.PSW.AE << 13;
-      result |= CPU.PSW.EP << 14;
-      result |= CPU.PSW.NP << 15;
-      result |= CPU.PSW.I << 16;
-      printf("[PSW] unimpl read\n");
-      break;
+    case ECR: result = ((uint32_t)CPU.ECR.FECC << 16) | CPU.ECR.EICC; break;
+    case EIPC: result = CPU.EIPC; break;
+    case EIPSW: result = CPU.EIPSW; break;
+    case FEPC: result = CPU.FEPC; break;
+    case FEPSW: result = CPU.FEPSW; break;
+    case PIR: result = CPU.PIR; break;
+    case PSW: result = psw_read(vb); break;
 
     case TKCW:
-      vb_log_fatal("[TKCW] unimpl read\n");
+      // fixed on the v810, all traps enabled, round to nearest.
+      result = 0x000000E0;
       break;
 
     case ABS:
@@ -755,626 +906,1430 @@ static inline void STSR(struct VB_Core* vb, struct Format2 f) {
       break;
 
     default:
-      vb_log_fatal("[unk] unimpl read, index: %u\n", f.lo5);
+      vb_log_fatal("[unk] unimpl read, index: %u\n", op->imm);
       break;
   }
 
-  REGISTERS[f.reg2] = result;
+  REGISTERS[op->reg2] = result;
+}
+
+static void RETI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  VB_UNUSED(op);
+
+  // NP means it's returning from a duplexed exception.
+  if (CPU.PSW.NP) {
+    REG_PC = CPU.FEPC;
+    psw_write(vb, CPU.FEPSW);
+  }
+  else {
+    REG_PC = CPU.EIPC;
+    psw_write(vb, CPU.EIPSW);
+  }
+}
+
+static void TRAP(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t vector = op->imm & 0x1F;
+  // returns to the instruction after the trap.
+  enter_exception(vb, 0xFFA0 + vector, 0xFFFFFFA0 + (vector & 0x10), REG_PC);
 }
 
 
 // [Nintendo - Standalone]
-static inline void CLI(struct VB_Core* vb) {
+static void CLI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  VB_UNUSED(op);
   CPU.PSW.ID = false;
+  irq_update(vb);
   // cycles 12; // why is this instruction so slow???
   // assert(0);
 }
 
-static inline void SEI(struct VB_Core* vb) {
+static void SEI(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  VB_UNUSED(op);
   CPU.PSW.ID = true;
+  irq_update(vb);
   // cycles 12; // why is this instruction so slow???
   // assert(0);
 }
 
 
 // [Nintendo - Extended]
-static inline void MPYHW(struct VB_Core* vb, struct Format7 f) {
-  const int32_t a = REGISTERS[f.reg2];
-  const int32_t b = bit_sign_extend(16, REGISTERS[f.reg1]);
-  REGISTERS[f.reg2] = a * b;
+static void MPYHW(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  // reg2 = reg2 * the lower 17 bits of reg1, signed.
+  const uint32_t b = bit_sign_extend(16, REGISTERS[op->reg1]);
+  REGISTERS[op->reg2] = REGISTERS[op->reg2] * b;
 }
 
-static inline void REV(struct VB_Core* vb, struct Format7 f) {
-  const uint32_t value = REGISTERS[f.reg2];
+static void REV(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  // reg2 = reg1 with the bits reversed
+  const uint32_t value = REGISTERS[op->reg1];
   uint32_t result = 0;
 
   #if USE_BUILTIN && HAS_BUILTIN(__builtin_bitreverse32)
     result = __builtin_bitreverse32(value);
   #else
     for (size_t i = 0; i < 32; i++) {
-      result |= bit_is_set(31 - i, value) << i;
+      result |= (uint32_t)bit_is_set(31 - i, value) << i;
     }
   #endif
 
-  REGISTERS[f.reg2] = result;
+  REGISTERS[op->reg2] = result;
 }
 
-static inline void XB(struct VB_Core* vb, struct Format7 f) {
-  const uint32_t reg2 = REGISTERS[f.reg2];
-  REGISTERS[f.reg2] = (reg2 & 0xFFFF0000) | ((reg2 << 8) & 0xFF00) | ((reg2 >> 8) & 0x00FF);
+static void XB(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  // swaps the bytes of the lower halfword
+  const uint32_t reg2 = REGISTERS[op->reg2];
+  REGISTERS[op->reg2] = (reg2 & 0xFFFF0000) | ((reg2 << 8) & 0xFF00) | ((reg2 >> 8) & 0x00FF);
 }
 
-static inline void XH(struct VB_Core* vb, struct Format7 f) {
-  const uint32_t reg2 = REGISTERS[f.reg2];
-  REGISTERS[f.reg2] = (reg2 >> 16) | (reg2 << 16);
+static void XH(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  // swaps the halfwords
+  const uint32_t reg2 = REGISTERS[op->reg2];
+  REGISTERS[op->reg2] = (reg2 >> 16) | (reg2 << 16);
 }
 
 
-// [Floating-Point]
-static inline void set_float_flags(struct VB_Core* vb, float result) {
-  FLAG_Z = fpclassify(result) == FP_ZERO;
-  FLAG_S = signbit(result);
-  FLAG_OV = 0;
-  FLAG_CY = signbit(result); // ???
+// [Bit Strings]
+// a bit string is given by a word address and a bit offset within that word:
+// r30 / r27 for the source, r29 / r26 for the destination, and r28 is the
+// length in bits. they can be very long, so rather than a bit at a time,
+// these work on as many bits as fit in the destination word at once.
+//
+// the registers are written back as they go, and if the cpu runs out of
+// cycles part way, the pc is left on the instruction so that it carries
+// on from there next slice (or after an interrupt returns to it).
+// the per word costs are rough, the real timings aren't known.
 
-  // FLT_MAX
-  // FLT_MIN
-  // isnan
-  //
+enum {
+  BSTR_SEARCH_WORD_CYCLES = 3, // read
+  BSTR_BITWISE_WORD_CYCLES = 6, // read src, read dst, write dst
+};
 
-  // FPR =
-  // FUD =
-  // FOV =
-  // FRO =
+// mask of the low n bits, n can be 0-32.
+static inline uint32_t bstr_mask(uint32_t n) {
+  return n >= 32 ? 0xFFFFFFFF : (1U << n) - 1;
 }
 
-// Add Floating Short 	reg2 = reg2 + reg1
-static inline void ADDF_S(struct VB_Core* vb, struct Format7 f) {
-  const float a = REGISTERS[f.reg2];
-  const float b = REGISTERS[f.reg1];
-  const float result = a + b;
-
-  set_float_flags(vb, result);
+static inline uint32_t bstr_ctz(uint32_t value) {
+  assert(value && "ctz of zero is undefined");
 
-  REGISTERS[f.reg2] = result;
+  #if USE_BUILTIN && HAS_BUILTIN(__builtin_ctz)
+    return __builtin_ctz(value);
+  #else
+    uint32_t n = 0;
+    while (!(value & 1)) { value >>= 1; n++; }
+    return n;
+  #endif
 }
 
-// Compare Floating Short 	(discard) = reg2 - reg1
-static inline void CMPF_S(struct VB_Core* vb, struct Format7 f) {
-  const float a = REGISTERS[f.reg2];
-  const float b = REGISTERS[f.reg1];
-  const float result = a - b;
+static inline uint32_t bstr_clz(uint32_t value) {
+  assert(value && "clz of zero is undefined");
 
-  set_float_flags(vb, result);
+  #if USE_BUILTIN && HAS_BUILTIN(__builtin_clz)
+    return __builtin_clz(value);
+  #else
+    uint32_t n = 0;
+    while (!(value & 0x80000000)) { value <<= 1; n++; }
+    return n;
+  #endif
 }
 
-// Convert Short Floating to Word Integer 	reg2 = (word) round(reg1)
-static inline void CVT_SW(struct VB_Core* vb, struct Format7 f) {
-  const float result = roundf(REGISTERS[f.reg1]);
-
-  set_float_flags(vb, result);
-
-  REGISTERS[f.reg2] = result;
+// leaves the pc on the instruction, so that it runs again from where it
+// got to, which is all in the registers.
+static inline void bstr_resume_later(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REG_PC -= op->size;
 }
 
-// Convert Word Integer to Short Floating 	reg2 = (float) reg1
-static inline void CVT_WS(struct VB_Core* vb, struct Format7 f) {
-  const float result = (float)REGISTERS[f.reg1];
+// r29 counts the bits that were skipped over, and once found, r30 / r27
+// are left on the bit after the one found. Z is set if nothing was found.
+static void bstr_search(struct VB_Core* vb, const struct VB_DecodedOp* op, bool ones, bool down) {
+  uint32_t addr = align_32(REGISTERS[30]);
+  int32_t offset = REGISTERS[27] & 31;
+  uint32_t len = REGISTERS[28];
+  uint32_t skipped = REGISTERS[29];
+  bool found = false;
 
-  set_float_flags(vb, result);
+  while (len && !found) {
+    const uint32_t word = ones ? READ32(addr) : ~READ32(addr);
+    uint32_t bits, hits;
 
-  REGISTERS[f.reg2] = result;
-}
+    if (!down) {
+      // bits [offset, offset + bits) moved down to the bottom.
+      bits = VB_MIN(len, 32 - (uint32_t)offset);
+      hits = (word >> offset) & bstr_mask(bits);
+      const uint32_t n = hits ? bstr_ctz(hits) + 1 : bits;
 
-// Divide Floating Short 	reg2 = reg2 / reg1
-static inline void DIVF_S(struct VB_Core* vb, struct Format7 f) {
-  const float a = REGISTERS[f.reg2];
-  const float b = REGISTERS[f.reg1];
-  assert((a > 0.0F || a < 0.0F) && (b > 0.0F || b < 0.0F));
-  const float result = a / b;
+      skipped += hits ? n - 1 : n;
+      len -= n;
+      offset += n;
 
-  set_float_flags(vb, result);
+      if (offset >= 32) {
+        offset -= 32;
+        addr += 4;
+      }
+    }
+    else {
+      // bits (offset - bits, offset] moved up to the top.
+      bits = VB_MIN(len, (uint32_t)offset + 1);
+      hits = (word << (31 - offset)) & ~bstr_mask(32 - bits);
+      const uint32_t n = hits ? bstr_clz(hits) + 1 : bits;
+
+      skipped += hits ? n - 1 : n;
+      len -= n;
+      offset -= n;
+
+      if (offset < 0) {
+        offset += 32;
+        addr -= 4;
+      }
+    }
 
-  REGISTERS[f.reg2] = result;
-}
+    found = hits != 0;
+    vb->cycles_left -= BSTR_SEARCH_WORD_CYCLES;
 
-// Multiply Floating Short 	reg2 = reg2 * reg1
-static inline void MULF_S(struct VB_Core* vb, struct Format7 f) {
-  const float a = REGISTERS[f.reg2];
-  const float b = REGISTERS[f.reg1];
-  const float result = a * b;
+    if (len && !found && vb->cycles_left <= 0) {
+      bstr_resume_later(vb, op);
+      break;
+    }
+  }
 
-  set_float_flags(vb, result);
+  REGISTERS[30] = addr;
+  REGISTERS[27] = offset;
+  REGISTERS[28] = len;
+  REGISTERS[29] = skipped;
 
-  REGISTERS[f.reg2] = result;
+  if (found || !len) {
+    flags_sync(vb);
+    FLAG_Z = !found;
+    flags_load(vb);
+  }
 }
 
-// Subtract Floating Short 	reg2 = reg2 - reg1
-static inline void SUBF_S(struct VB_Core* vb, struct Format7 f) {
-  const float a = REGISTERS[f.reg2];
-  const float b = REGISTERS[f.reg1];
-  const float result = a - b;
+static void bstr_bitwise(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  uint32_t src_addr = align_32(REGISTERS[30]);
+  uint32_t dst_addr = align_32(REGISTERS[29]);
+  uint32_t src_offset = REGISTERS[27] & 31;
+  uint32_t dst_offset = REGISTERS[26] & 31;
+  uint32_t len = REGISTERS[28];
 
-  set_float_flags(vb, result);
+  while (len) {
+    // as many bits as are left in the destination word.
+    const uint32_t bits = VB_MIN(len, 32 - dst_offset);
+    const uint32_t mask = bstr_mask(bits) << dst_offset;
 
-  REGISTERS[f.reg2] = result;
-}
+    // the source bits can span 2 words.
+    uint32_t src = READ32(src_addr) >> src_offset;
+    if (src_offset + bits > 32) {
+      src |= READ32(src_addr + 4) << (32 - src_offset);
+    }
+    src <<= dst_offset;
+
+    // a whole word being moved doesn't need the old one.
+    const uint32_t dst = (op->sub == 0x0B && mask == 0xFFFFFFFF) ? 0 : READ32(dst_addr);
+    uint32_t result;
+
+    switch (op->sub) {
+      case 0x08: result = dst | src; break; // orbsu
+      case 0x09: result = dst & src; break; // andbsu
+      case 0x0A: result = dst ^ src; break; // xorbsu
+      case 0x0B: result = src; break; // movbsu
+      case 0x0C: result = dst | ~src; break; // ornbsu
+      case 0x0D: result = dst & ~src; break; // andnbsu
+      case 0x0E: result = dst ^ ~src; break; // xornbsu
+      case 0x0F: result = ~src; break; // notbsu
+      default: assert(!"not a bitwise bit string op"); result = dst; break;
+    }
 
-// Truncate Short Floating to Word Integer 	reg2 = (word) truncate(reg1)
-static inline void TRNC_S(struct VB_Core* vb, struct Format7 f) {
-  const float result = truncf(REGISTERS[f.reg1]);
+    WRITE32(dst_addr, (dst & ~mask) | (result & mask));
 
-  FLAG_Z = fpclassify(result) == FP_ZERO;
-  FLAG_S = signbit(result);
-  FLAG_OV = 0;
+    len -= bits;
+    src_offset += bits;
+    dst_offset += bits;
 
-  REGISTERS[f.reg2] = result;
-}
+    if (src_offset >= 32) {
+      src_offset -= 32;
+      src_addr += 4;
+    }
 
-static void sub_execute_float(struct VB_Core* vb, struct Format7 f) {
-  switch (f.subop & 0x3F) {
-  // [Floating-Point]
-    case 0x04:
-      vb_log("[CPU] ADDF.S\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      ADDF_S(vb, f);
-      break;
+    if (dst_offset >= 32) {
+      dst_offset -= 32;
+      dst_addr += 4;
+    }
 
-    case 0x00:
-      vb_log("[CPU] CMPF.S\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      CMPF_S(vb, f);
-      break;
+    vb->cycles_left -= BSTR_BITWISE_WORD_CYCLES;
 
-    case 0x03:
-      vb_log("[CPU] CVT.SW\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      CVT_SW(vb, f);
+    if (len && vb->cycles_left <= 0) {
+      bstr_resume_later(vb, op);
       break;
+    }
+  }
 
-    case 0x02:
-      vb_log("[CPU] CVT.WS\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      CVT_WS(vb, f);
-      break;
+  REGISTERS[30] = src_addr;
+  REGISTERS[29] = dst_addr;
+  REGISTERS[28] = len;
+  REGISTERS[27] = src_offset;
+  REGISTERS[26] = dst_offset;
+}
 
-    case 0x07:
-      vb_log("[CPU] DIVF.S\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      DIVF_S(vb, f);
-      break;
+// Search Bit 0 Upward / Downward, Search Bit 1 Upward / Downward
+static inline void SCH0BSU(struct VB_Core* vb, const struct VB_DecodedOp* op) { bstr_search(vb, op, false, false); }
+static inline void SCH0BSD(struct VB_Core* vb, const struct VB_DecodedOp* op) { bstr_search(vb, op, false, true); }
+static inline void SCH1BSU(struct VB_Core* vb, const struct VB_DecodedOp* op) { bstr_search(vb, op, true, false); }
+static inline void SCH1BSD(struct VB_Core* vb, const struct VB_DecodedOp* op) { bstr_search(vb, op, true, true); }
 
-    case 0x06:
-      vb_log("[CPU] MULF.S\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      MULF_S(vb, f);
-      break;
+// the rest are dst = dst (op) src, the N versions use ~src.
+static inline void BSTR_BITWISE(struct VB_Core* vb, const struct VB_DecodedOp* op) { bstr_bitwise(vb, op); }
 
-    case 0x05:
-      vb_log("[CPU] SUBF.S\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      SUBF_S(vb, f);
-      break;
 
-    case 0x0B:
-      vb_log("[CPU] TRNC.S\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      TRNC_S(vb, f);
-      break;
+// [Floating-Point]
+// registers hold the raw bits of an ieee-754 single, which the host fpu
+// works on directly. each op is done in double and then rounded to single,
+// which gives the same (correctly rounded) result as doing it in single,
+// and leaves enough of the result around to tell if anything was lost.
+//
+// what the v810 does differently is check for the cases below, it never
+// produces or accepts nan / inf / denormals.
+//
+// every float compare in here is meant to be exact.
+#if defined(__GNUC__)
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wfloat-equal"
+#endif
 
-  // [Nintendo Extended]
-    case 0x0C:
-      vb_log("[CPU] MPYHW\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      MPYHW(vb, f);
-      break;
+enum {
+  // exception codes, see float_exception()
+  FLOAT_CODE_RESERVED = 0xFF60, // reserved operand (FRO)
+  FLOAT_CODE_OVERFLOW = 0xFF64, // result too big (FOV)
+  FLOAT_CODE_ZERO_DIVIDE = 0xFF68, // x / 0 (FZD)
+  FLOAT_CODE_INVALID = 0xFF70, // 0 / 0, or out of range conversion (FIV)
+};
 
-    case 0x0A:
-      vb_log("[CPU] REV\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      REV(vb, f);
-      break;
+static inline float float_from_bits(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
 
-    case 0x08:
-      vb_log("[CPU] XB\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      XB(vb, f);
-      break;
+static inline uint32_t float_to_bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
 
-    case 0x09:
-      vb_log("[CPU] XH\tFormat 7\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      XH(vb, f);
-      break;
+// nan, inf and denormals, zero is fine.
+static inline bool float_is_reserved(uint32_t bits) {
+  const uint32_t exponent = (bits >> 23) & 0xFF;
+  return exponent == 0xFF || (exponent == 0 && (bits & 0x7FFFFF));
+}
 
-    default:
-      assert(0);
-      break;
+// the op is abandoned, leaving its destination as it was, and the handler
+// returns to the op itself. float ops are all 4 bytes.
+static void float_exception(struct VB_Core* vb, uint16_t code) {
+  switch (code) {
+    case FLOAT_CODE_RESERVED: CPU.PSW.FRO = true; break;
+    case FLOAT_CODE_OVERFLOW: CPU.PSW.FOV = true; break;
+    case FLOAT_CODE_ZERO_DIVIDE: CPU.PSW.FZD = true; break;
+    case FLOAT_CODE_INVALID: CPU.PSW.FIV = true; break;
   }
+
+  vb_log_err("[FPU] exception: 0x%04X\n", code);
+  enter_exception(vb, code, 0xFFFFFF60, REG_PC - 4);
 }
 
-static void sub_execute_bit_strings(struct VB_Core* vb, uint16_t opa) {
-  VB_UNUSED(opa);
+static inline bool float_check_operands(struct VB_Core* vb, uint32_t a, uint32_t b) {
+  if (VB_UNLIKELY(float_is_reserved(a) || float_is_reserved(b))) {
+    float_exception(vb, FLOAT_CODE_RESERVED);
+    return false;
+  }
 
-  const uint16_t opcode = READ16(REG_PC);
-  REG_PC += 2;
+  return true;
+}
 
-  switch ((opcode >> 11) & 0x1F) {
-  // [Bitwise]
-    case 0x09:
-      vb_log("[CPU] ANDBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+static inline void set_float_flags(struct VB_Core* vb, float result) {
+  FLAG_Z = result == 0.0F;
+  FLAG_S = signbit(result);
+  FLAG_OV = 0;
+  FLAG_CY = FLAG_S;
+  flags_load(vb);
+}
 
-    case 0x0D:
-      vb_log("[CPU] ANDNBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+// CY is left as it was when converting to an int.
+static inline void set_float_int_flags(struct VB_Core* vb, int32_t result) {
+  flags_sync(vb);
+  FLAG_Z = result == 0;
+  FLAG_S = result < 0;
+  FLAG_OV = 0;
+  flags_load(vb);
+}
 
-    case 0x0B:
-      vb_log("[CPU] MOVBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+// rounds the exact (or already correctly rounded) result to single, and
+// writes it to reg2, inexact is true if the double wasn't exact.
+static inline void float_result(struct VB_Core* vb, const struct VB_DecodedOp* op, double exact, bool inexact) {
+  float result = (float)exact;
 
-    case 0x1F:
-      vb_log("[CPU] NOTBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+  if (VB_UNLIKELY(isinf(result))) {
+    float_exception(vb, FLOAT_CODE_OVERFLOW);
+    return;
+  }
 
-    case 0x08:
-      vb_log("[CPU] ORBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+  if (VB_UNLIKELY(fabs(exact) < (double)FLT_MIN && exact != 0.0)) {
+    // denormals are flushed to zero.
+    result = copysignf(0.0F, result);
+    CPU.PSW.FUD = true;
+    inexact = true;
+  }
 
-    case 0x0C:
-      vb_log("[CPU] ORNBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+  if (inexact || (double)result != exact) {
+    CPU.PSW.FPR = true;
+  }
 
-    case 0x0A:
-      vb_log("[CPU] XORBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+  set_float_flags(vb, result);
+  REGISTERS[op->reg2] = float_to_bits(result);
+}
 
-    case 0x0E:
-      vb_log("[CPU] XORNBSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+// Add Floating Short 	reg2 = reg2 + reg1
+static void ADDF_S(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t a = REGISTERS[op->reg2];
+  const uint32_t b = REGISTERS[op->reg1];
 
-  // [Search]
-    case 0x01:
-      vb_log("[CPU] SCH0BSD\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+  if (float_check_operands(vb, a, b)) {
+    double big = float_from_bits(a);
+    double small = float_from_bits(b);
 
-    case 0x00:
-      vb_log("[CPU] SCH0BSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+    if (fabs(big) < fabs(small)) {
+      const double tmp = big; big = small; small = tmp;
+    }
 
-    case 0x03:
-      vb_log("[CPU] SCH1BSD\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+    // the sum in double is only inexact if the exponents are far apart,
+    // what was lost is exactly (small - (sum - big)).
+    const double sum = big + small;
+    float_result(vb, op, sum, small - (sum - big) != 0.0);
+  }
+}
 
-    case 0x02:
-      vb_log("[CPU] SCH1BSU\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+// Subtract Floating Short 	reg2 = reg2 - reg1
+static void SUBF_S(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t a = REGISTERS[op->reg2];
+  const uint32_t b = REGISTERS[op->reg1];
 
-    default:
-      assert(0);
-      break;
+  if (float_check_operands(vb, a, b)) {
+    double big = float_from_bits(a);
+    double small = -(double)float_from_bits(b);
+
+    if (fabs(big) < fabs(small)) {
+      const double tmp = big; big = small; small = tmp;
+    }
+
+    const double sum = big + small;
+    float_result(vb, op, sum, small - (sum - big) != 0.0);
   }
 }
 
-static void execute(struct VB_Core* vb) {
-  const uint16_t opcode = READ16(REG_PC);
-  REG_PC += 2;
-
-  switch ((opcode >> 10) & 0x3F) {
-  // [Register Transfer]
-    case 0x10: // 0b010000
-      vb_log("[CPU] MOV\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      MOV_imm(vb, gen_format2(vb, opcode));
-      break;
+// Multiply Floating Short 	reg2 = reg2 * reg1
+static void MULF_S(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t a = REGISTERS[op->reg2];
+  const uint32_t b = REGISTERS[op->reg1];
+
+  if (float_check_operands(vb, a, b)) {
+    // 24 x 24 bits always fits in a double.
+    const double product = (double)float_from_bits(a) * (double)float_from_bits(b);
+    float_result(vb, op, product, false);
+  }
+}
 
-    case 0x00: // 0b000000
-      vb_log("[CPU] MOV\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      MOV_reg(vb, gen_format1(vb, opcode));
-      break;
+// Divide Floating Short 	reg2 = reg2 / reg1
+static void DIVF_S(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t a = REGISTERS[op->reg2];
+  const uint32_t b = REGISTERS[op->reg1];
 
-    case 0x28: // 0b101000
-      vb_log("[CPU] MOVEA\tFormat 5\tCOUNT [%zu]\n", vb->v810.step_count);
-      MOVEA(vb, gen_format5(vb, opcode));
-      break;
+  if (!float_check_operands(vb, a, b)) {
+    return;
+  }
 
-    case 0x2F: // 0b101111
-      vb_log("[CPU] MOVHI\tFormat 5\tCOUNT [%zu]\n", vb->v810.step_count);
-      MOVHI(vb, gen_format5(vb, opcode));
-      break;
+  const double dividend = float_from_bits(a);
+  const double divisor = float_from_bits(b);
 
-  // [Load and Input]
-    case 0x38: // 0b111000
-      vb_log("[CPU] IN.B\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      IN_B(vb, gen_format6(vb, opcode));
-      break;
+  if (VB_UNLIKELY(divisor == 0.0)) {
+    float_exception(vb, dividend == 0.0 ? FLOAT_CODE_INVALID : FLOAT_CODE_ZERO_DIVIDE);
+    return;
+  }
 
-    case 0x39: // 0b111001
-      vb_log("[CPU] IN.H\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      IN_H(vb, gen_format6(vb, opcode));
-      break;
+  const double quotient = dividend / divisor;
+  // exact if it multiplies back, which in double is exact too.
+  const double rounded = (float)quotient;
+  float_result(vb, op, quotient, rounded * divisor != dividend);
+}
 
-    case 0x3B: // 0b111011
-      vb_log("[CPU] IN.W\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      IN_W(vb, gen_format6(vb, opcode));
-      break;
+// Compare Floating Short 	(discard) = reg2 - reg1
+static void CMPF_S(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const uint32_t a = REGISTERS[op->reg2];
+  const uint32_t b = REGISTERS[op->reg1];
+
+  if (float_check_operands(vb, a, b)) {
+    const float fa = float_from_bits(a);
+    const float fb = float_from_bits(b);
+
+    FLAG_Z = !(fa < fb || fa > fb);
+    FLAG_S = fa < fb;
+    FLAG_OV = 0;
+    FLAG_CY = FLAG_S;
+    flags_load(vb);
+  }
+}
 
-    case 0x30: // 0b110000
-      vb_log("[CPU] LD.B\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      LD_B(vb, gen_format6(vb, opcode));
-      break;
+// Convert Word Integer to Short Floating 	reg2 = (float) reg1
+static void CVT_WS(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  const int32_t value = REGISTERS[op->reg1];
+  const float result = (float)value;
 
-    case 0x31: // 0b110001
-      vb_log("[CPU] LD.H\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      LD_H(vb, gen_format6(vb, opcode));
-      break;
+  // ints over 24 bits can lose their low bits.
+  if ((double)result != (double)value) {
+    CPU.PSW.FPR = true;
+  }
 
-    case 0x33: // 0b110011
-      vb_log("[CPU] LD.W\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      LD_W(vb, gen_format6(vb, opcode));
-      break;
+  set_float_flags(vb, result);
+  REGISTERS[op->reg2] = float_to_bits(result);
+}
 
-  // [Store and Output]
-    case 0x3C: // 0b111100
-      vb_log("[CPU] OUT.B\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      OUT_B(vb, gen_format6(vb, opcode));
-      break;
+static void float_to_int(struct VB_Core* vb, const struct VB_DecodedOp* op, bool truncate) {
+  const uint32_t bits = REGISTERS[op->reg1];
 
-    case 0x3D: // 0b111101
-      vb_log("[CPU] OUT.H\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      OUT_H(vb, gen_format6(vb, opcode));
-      break;
+  if (!float_check_operands(vb, bits, 0)) {
+    return;
+  }
 
-    case 0x3F: // 0b111111
-      vb_log("[CPU] OUT.W\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      OUT_W(vb, gen_format6(vb, opcode));
-      break;
+  const double value = float_from_bits(bits);
 
-    case 0x34: // 0b110100
-      vb_log("[CPU] ST.B\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      ST_B(vb, gen_format6(vb, opcode));
-      break;
+  // way out of range, this also keeps the rounding below in range.
+  if (VB_UNLIKELY(fabs(value) >= 4294967296.0)) {
+    float_exception(vb, FLOAT_CODE_INVALID);
+    return;
+  }
 
-    case 0x35: // 0b110101
-      vb_log("[CPU] ST.H\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      ST_H(vb, gen_format6(vb, opcode));
-      break;
+  int64_t rounded;
 
-    case 0x37: // 0b110111
-      vb_log("[CPU] ST.W\tFormat 6\tCOUNT [%zu]\n", vb->v810.step_count);
-      ST_W(vb, gen_format6(vb, opcode));
-      break;
+  if (truncate) {
+    rounded = (int64_t)value;
+  }
+  else {
+    // rounds to nearest even (the v810 default), as adding 2^52 leaves no
+    // bits for the fraction, so the host rounds it off.
+    const double magnitude = (fabs(value) + 0x1p52) - 0x1p52;
+    rounded = (int64_t)(value < 0.0 ? -magnitude : magnitude);
+  }
 
-  // [Arithmetic]
-    case 0x11: // 0b010001
-      vb_log("[CPU] ADD\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      ADD_imm(vb, gen_format2(vb, opcode));
-      break;
+  if (VB_UNLIKELY(rounded > INT32_MAX || rounded < INT32_MIN)) {
+    float_exception(vb, FLOAT_CODE_INVALID);
+    return;
+  }
 
-    case 0x01: // 0b000001
-      vb_log("[CPU] ADD\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      ADD_reg(vb, gen_format1(vb, opcode));
-      break;
+  if ((double)rounded != value) {
+    CPU.PSW.FPR = true;
+  }
 
-    case 0x29: // 0b101001
-      vb_log("[CPU] ADDI\tFormat 5\tCOUNT [%zu]\n", vb->v810.step_count);
-      ADDI(vb, gen_format5(vb, opcode));
-      break;
+  const int32_t result = (int32_t)rounded;
+  set_float_int_flags(vb, result);
+  REGISTERS[op->reg2] = result;
+}
 
-    case 0x13: // 0b010011
-      vb_log("[CPU] CMP\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      CMP_imm(vb, gen_format2(vb, opcode));
-      break;
+// Convert Short Floating to Word Integer 	reg2 = (word) round(reg1)
+static void CVT_SW(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  float_to_int(vb, op, false);
+}
 
-    case 0x03: // 0b000011
-      vb_log("[CPU] CMP\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      CMP_reg(vb, gen_format1(vb, opcode));
-      break;
+// Truncate Short Floating to Word Integer 	reg2 = (word) truncate(reg1)
+static void TRNC_S(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  float_to_int(vb, op, true);
+}
 
-    case 0x09: // 0b001001
-      vb_log("[CPU] DIV\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+#if defined(__GNUC__)
+  #pragma GCC diagnostic pop
+#endif
 
-    case 0x0B: // 0b001011
-      vb_log("[CPU] DIVU\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
-      break;
+// [Fused]
+// pairs of instructions that are run as one, see [Fusion].
+// these are given the first op, the second is the one after it.
 
-    case 0x08: // 0b001000
-      vb_log("[CPU] MUL\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      MUL(vb, gen_format1(vb, opcode));
-      break;
+// moves on to the second op, the same as the dispatcher does.
+static inline void fused_next(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  REGISTERS[ZERO_REGISTER] = 0; // forced to zero
+  REG_PC += op[1].size;
+  vb->cycles_left -= op[1].cycles;
+}
 
-    case 0x0A: // 0b001010
-      vb_log("[CPU] MULU\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      MULU(vb, gen_format1(vb, opcode));
-      break;
+#define FUSED_PAIR(name, first, second) \
+  static void name(struct VB_Core* vb, const struct VB_DecodedOp* op) { \
+    first(vb, op); \
+    fused_next(vb, op); \
+    second(vb, op + 1); \
+  }
 
-    case 0x02: // 0b000010
-      vb_log("[CPU] SUB\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      SUB_reg(vb, gen_format1(vb, opcode));
-      break;
+FUSED_PAIR(MOVHI_MOVEA, MOVHI, MOVEA)
+FUSED_PAIR(MOVHI_LD_B, MOVHI, LD_B)
+FUSED_PAIR(MOVHI_LD_H, MOVHI, LD_H)
+FUSED_PAIR(MOVHI_LD_W, MOVHI, LD_W)
+FUSED_PAIR(MOVHI_ST_B, MOVHI, ST_B)
+FUSED_PAIR(MOVHI_ST_H, MOVHI, ST_H)
+FUSED_PAIR(MOVHI_ST_W, MOVHI, ST_W)
+
+#undef FUSED_PAIR
+
+// the branch is decided straight from the compare, so the flags it set
+// can stay pending, see [Flags].
+static inline bool cmp_condition(uint32_t a, uint32_t b, uint8_t cond) {
+  const uint32_t result = a - b;
+
+  switch (cond & 15) {
+    case BV: return bit_is_set(31, (a ^ b) & (a ^ result));
+    case BC: return a < b;
+    case BE: return a == b;
+    case BNH: return a <= b;
+    case BN: return bit_is_set(31, result);
+    case BR: return true;
+    case BLT: return (int32_t)a < (int32_t)b;
+    case BLE: return (int32_t)a <= (int32_t)b;
+    case BNV: return !bit_is_set(31, (a ^ b) & (a ^ result));
+    case BNC: return a >= b;
+    case BNE: return a != b;
+    case BH: return a > b;
+    case BP: return !bit_is_set(31, result);
+    case NOP: return false;
+    case BGE: return (int32_t)a >= (int32_t)b;
+    case BGT: return (int32_t)a > (int32_t)b;
+  }
 
-  // [Bitwise]
-    case 0x0D:
-      vb_log("[CPU] AND\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      AND(vb, gen_format1(vb, opcode));
-      break;
+  return false;
+}
 
-    case 0x2D:
-      vb_log("[CPU] ANDI\tFormat 5\tCOUNT [%zu]\n", vb->v810.step_count);
-      ANDI(vb, gen_format5(vb, opcode));
-      break;
+static void cmp_bcond(struct VB_Core* vb, const struct VB_DecodedOp* op, uint32_t b) {
+  const uint32_t a = REGISTERS[op->reg2];
 
-    case 0x0F:
-      vb_log("[CPU] NOT\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      NOT(vb, gen_format1(vb, opcode));
-      break;
+  sub_internal(vb, a, b);
+  fused_next(vb, op);
 
-    case 0x0C:
-      vb_log("[CPU] OR\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      OR(vb, gen_format1(vb, opcode));
-      break;
+  if (cmp_condition(a, b, op[1].sub)) {
+    branch_taken(vb, op + 1);
+  }
+}
 
-    case 0x2C:
-      vb_log("[CPU] ORI\tFormat 5\tCOUNT [%zu]\n", vb->v810.step_count);
-      ORI(vb, gen_format5(vb, opcode));
-      break;
+static void CMP_reg_Bcond(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  cmp_bcond(vb, op, REGISTERS[op->reg1]);
+}
 
-    case 0x17:
-      vb_log("[CPU] SAR\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      SARI(vb, gen_format2(vb, opcode));
-      break;
+static void CMP_imm_Bcond(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  cmp_bcond(vb, op, op->imm);
+}
 
-    case 0x07:
-      vb_log("[CPU] SAR\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      SAR(vb, gen_format1(vb, opcode));
-      break;
+static void UNIMPLEMENTED(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  VB_UNUSED(vb); VB_UNUSED(op);
+  assert(!"instruction not implemented!");
+}
 
-    case 0x14:
-      vb_log("[CPU] SHL\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      SHLI(vb, gen_format2(vb, opcode));
-      break;
+static void UNKNOWN(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  VB_UNUSED(vb); VB_UNUSED(op);
+  assert(!"UNK instruction!");
+}
 
-    case 0x04:
-      vb_log("[CPU] SHL\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      SHL(vb, gen_format1(vb, opcode));
-      break;
 
-    case 0x15:
-      vb_log("[CPU] SHR\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      SHRI(vb, gen_format2(vb, opcode));
-      break;
+// [Decode]
+struct OpInfo {
+  VB_OpHandler handler;
+  const char* mnemonic;
+  uint8_t format; // V810Format
+  uint8_t flags; // VB_DecodedOpFlag
+  uint8_t cycles;
+};
 
-    case 0x05:
-      vb_log("[CPU] SHR\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      SHR(vb, gen_format1(vb, opcode));
-      break;
+#define COUNT_OP(...) + 1
+static_assert((0 V810_OPS(COUNT_OP)) == 64, "every primary opcode needs an entry");
+#undef COUNT_OP
+
+static const struct OpInfo OP_TABLE[64] = {
+  #define X(opcode, mnemonic, format, handler, cycles, flags) [opcode] = { handler, mnemonic, format, flags, cycles },
+  V810_OPS(X)
+  #undef X
+};
+
+static const struct OpInfo FLOAT_TABLE[16] = {
+  #define X(sub, mnemonic, handler, cycles) [sub] = { handler, mnemonic, FORMAT_7, 0, cycles },
+  V810_FLOAT_OPS(X)
+  #undef X
+};
+
+static const struct OpInfo BSTR_TABLE[16] = {
+  #define X(sub, mnemonic, handler, cycles) [sub] = { handler, mnemonic, FORMAT_2_BSTR, 0, cycles },
+  V810_BSTR_OPS(X)
+  #undef X
+};
+
+static const struct OpInfo UNKNOWN_INFO = { UNKNOWN, "???", FORMAT_NONE, VB_OP_FLAG_BRANCH, 1 };
+
+static const struct OpInfo* op_info(uint8_t id) {
+  if (id < OP_ID_FLOAT) {
+    return &OP_TABLE[id];
+  }
+  else if (id < OP_ID_BSTR) {
+    return &FLOAT_TABLE[id - OP_ID_FLOAT];
+  }
+  else if (id < OP_ID_UNKNOWN) {
+    return &BSTR_TABLE[id - OP_ID_BSTR];
+  }
+  else {
+    return &UNKNOWN_INFO;
+  }
+}
+
+// the subop tables have holes, anything not in the spec is unknown.
+static uint8_t sub_op_id(const struct OpInfo* table, uint8_t base, uint8_t sub) {
+  return (sub < 16 && table[sub].handler) ? base + sub : OP_ID_UNKNOWN;
+}
+
+// only touches op, so the rom analysis can use it off the cpu's thread.
+void vb_v810_decode(struct VB_DecodedOp* op, uint16_t opcode, uint16_t next) {
+  memset(op, 0, sizeof(*op));
+  op->size = 2;
+  op->opcode = (opcode >> 10) & 0x3F;
+  op->id = op->opcode;
 
-    case 0x0E:
-      vb_log("[CPU] XOR\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      XOR(vb, gen_format1(vb, opcode));
+  switch ((enum V810Format)OP_TABLE[op->opcode].format) {
+    case FORMAT_NONE:
       break;
 
-    case 0x2E:
-      vb_log("[CPU] XORI\tFormat 5\tCOUNT [%zu]\n", vb->v810.step_count);
-      XORI(vb, gen_format5(vb, opcode));
+    case FORMAT_1:
+    case FORMAT_1_JMP:
+      gen_format1(op, opcode);
       break;
 
-  // [CPU Control]
-    case 0x20:
-    case 0x21:
-    case 0x22:
-    case 0x23:
-    case 0x24:
-    case 0x25:
-    case 0x26:
-    case 0x27:
-      vb_log("[CPU] Bcond\tFormat 3\tCOUNT [%zu]\n", vb->v810.step_count);
-      Bcond(vb, gen_format3(vb, opcode));
+    case FORMAT_2:
+    case FORMAT_2_LDSR:
+    case FORMAT_2_STSR:
+    case FORMAT_2_TRAP:
+      gen_format2(op, opcode);
       break;
 
-    case 0x1A: // 0b011010:
-      vb_log("[CPU] HALT\tFormat 3\tCOUNT [%zu]\n", vb->v810.step_count);
-      HALT(vb, gen_format2(vb, opcode));
+    case FORMAT_2_SIGNED:
+      gen_format2_signed(op, opcode);
       break;
 
-    case 0x2B:
-      vb_log("[CPU] JAL\tFormat 4\tCOUNT [%zu]\n", vb->v810.step_count);
-      JAL(vb, gen_format4(vb, opcode));
+    case FORMAT_2_BSTR:
+      gen_format2(op, opcode);
+      op->sub = op->imm;
+      op->id = sub_op_id(BSTR_TABLE, OP_ID_BSTR, op->sub);
       break;
 
-    case 0x06:
-      vb_log("[CPU] JMP\tFormat 1\tCOUNT [%zu]\n", vb->v810.step_count);
-      JMP(vb, gen_format1(vb, opcode));
+    case FORMAT_3:
+      gen_format3(op, opcode);
       break;
 
-    case 0x2A:
-      vb_log("[CPU] JR\tFormat 4\tCOUNT [%zu]\n", vb->v810.step_count);
-      JR(vb, gen_format4(vb, opcode));
+    case FORMAT_4:
+      gen_format4(op, opcode, next);
       break;
 
-    case 0x1C: // 0b011100
-      vb_log("[CPU] LDSR\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      LDSR(vb, gen_format2(vb, opcode));
+    case FORMAT_5:
+      gen_format5(op, opcode, next);
       break;
 
-    case 0x19:
-      vb_log("[CPU] RETI\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
+    case FORMAT_5_SIGNED:
+      gen_format5_signed(op, opcode, next);
       break;
 
-    case 0x1D:
-      vb_log("[CPU] STSR\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      // assert(!"instruction not implemented!");
-      STSR(vb, gen_format2(vb, opcode));
+    case FORMAT_5_HI:
+      gen_format5(op, opcode, next);
+      op->imm = (int32_t)((uint32_t)op->imm << 16);
       break;
 
-    case 0x18:
-      vb_log("[CPU] TRAP\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
+    case FORMAT_6_LOAD:
+    case FORMAT_6_STORE:
+      gen_format6(op, opcode, next);
       break;
 
-  // [Floating-Point] - [Nintendo - Extended]
-    case 0x3E:
-      sub_execute_float(vb, gen_format7(vb, opcode));
+    case FORMAT_7:
+      gen_format7(op, opcode, next);
+      op->id = sub_op_id(FLOAT_TABLE, OP_ID_FLOAT, op->sub);
       break;
+  }
+
+  const struct OpInfo* info = op_info(op->id);
+  op->handler = info->handler;
+  op->flags = info->flags;
+  op->cycles = info->cycles;
+}
+
+static void decode(struct VB_Core* vb, uint32_t addr, struct VB_DecodedOp* op) {
+  const uint16_t opcode = READ16(addr);
+  // the second halfword is only read by the 32-bit formats.
+  const uint16_t next = ((opcode >> 10) & 0x3F) >= 0x28 ? READ16(addr + 2) : 0;
+
+  vb_v810_decode(op, opcode, next);
+
+  vb_log("[CPU] %s\tCOUNT [%zu]\n", op_info(op->id)->mnemonic, vb->v810.step_count);
+  log_decoded_op(vb, op);
+}
+
+static inline bool is_rom_addr(uint32_t addr) {
+  return ((addr >> 24) & 0x7) == 0x7;
+}
+
+static inline bool is_wram_addr(uint32_t addr) {
+  return ((addr >> 24) & 0x7) == 0x5;
+}
+
+// rom can never be written to, so anything decoded from it is valid for as
+// long as the rom is loaded. the cache is direct mapped on the rom offset and
+// tagged with (offset | 1), that way a zeroed entry is never a hit.
+// anything outside of rom (ie, code copied to wram) is decoded every time.
+static inline const struct VB_DecodedOp* fetch(struct VB_Core* vb, uint32_t addr, struct VB_DecodedOp* scratch) {
+  if (VB_LIKELY(is_rom_addr(addr))) {
+    const uint32_t offset = addr & vb->rom_mask;
+    const uint32_t tag = offset | 1;
+    struct VB_DecodedOp* op = &vb->predecode[(offset >> 1) & (VB_PREDECODE_ENTRIES - 1)];
+
+    if (VB_UNLIKELY(op->tag != tag)) {
+      decode(vb, addr, op);
+      op->tag = tag;
+    }
+
+    return op;
+  }
+
+  decode(vb, addr, scratch);
+  return scratch;
+}
+
+static void execute(struct VB_Core* vb) {
+  struct VB_DecodedOp scratch;
+  const struct VB_DecodedOp* op = fetch(vb, REG_PC, &scratch);
+
+  REGISTERS[ZERO_REGISTER] = 0; // forced to zero
+  vb->cycles_left -= op->cycles;
+
+  if (CPU.CHCW & CHCW_ICE) {
+    cache_fetch_range(vb, REG_PC, REG_PC + op->size);
+  }
+  else {
+    vb->cycles_left -= wait_states(vb, REG_PC, VB_Access_FETCH) * (op->size / 2);
+  }
+
+  REG_PC += op->size;
+  op->handler(vb, op);
+}
+
+
+// [Idle Loops]
+// most games spend most of a frame spinning on a vip register, or on a flag
+// in wram that an interrupt sets. if a block branches straight back to its
+// own start, never writes anything but registers, and every register it
+// reads is either set earlier in the same pass or never set at all, then
+// every pass does exactly the same thing until memory changes. nothing but
+// the cpu can change memory between events, so once one pass has run the
+// rest of the slice can be skipped, a whole pass at a time. that leaves the
+// cpu in the same state, on the same cycle, as running every pass would.
+
+// sets the registers the op reads and writes, false if it's not allowed.
+static bool idle_op_regs(const struct VB_DecodedOp* op, uint32_t* reads, uint32_t* writes) {
+  const uint32_t reg1 = 1u << op->reg1;
+  const uint32_t reg2 = 1u << op->reg2;
+
+  switch (op->opcode) {
+    case 0x00: case 0x0F: // mov, not
+    case 0x28: case 0x29: case 0x2C: case 0x2D: case 0x2E: case 0x2F: // movea, addi, ori, andi, xori, movhi
+    case 0x30: case 0x31: case 0x33: // ld.b, ld.h, ld.w
+    case 0x38: case 0x39: case 0x3B: // in.b, in.h, in.w
+      *reads = reg1; *writes = reg2;
+      return true;
+
+    case 0x01: case 0x02: case 0x04: case 0x05: case 0x07: // add, sub, shl, shr, sar
+    case 0x0C: case 0x0D: case 0x0E: // or, and, xor
+      *reads = reg1 | reg2; *writes = reg2;
+      return true;
+
+    case 0x03: // cmp
+      *reads = reg1 | reg2; *writes = 0;
+      return true;
+
+    case 0x10: // mov imm
+      *reads = 0; *writes = reg2;
+      return true;
+
+    case 0x11: case 0x14: case 0x15: case 0x17: // add, shl, shr, sar imm
+      *reads = reg2; *writes = reg2;
+      return true;
+
+    case 0x13: // cmp imm
+      *reads = reg2; *writes = 0;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// the flags don't need tracking, the only thing that reads them is the
+// branch at the end, and whatever sets them is already checked.
+static bool is_idle_loop(const struct VB_Block* block) {
+  const struct VB_DecodedOp* last = &block->ops[block->count - 1];
+
+  if ((last->opcode & 0x38) != 0x20 && last->opcode != 0x2A) { // bcond, jr
+    return false;
+  }
+
+  // both are relative to the branch itself.
+  if (block->end - last->size + last->imm != (block->tag & ~1)) {
+    return false;
+  }
+
+  uint32_t reads[VB_BLOCK_MAX_OPS], writes[VB_BLOCK_MAX_OPS];
+  uint32_t all_writes = 0;
+
+  for (uint16_t i = 0; i < block->count - 1; i++) {
+    if (!idle_op_regs(&block->ops[i], &reads[i], &writes[i])) {
+      return false;
+    }
+
+    all_writes |= writes[i];
+  }
+
+  // r0 is always zero, whatever is written to it.
+  uint32_t written = 1;
+
+  for (uint16_t i = 0; i < block->count - 1; i++) {
+    // reading something that the previous pass wrote.
+    if (reads[i] & all_writes & ~written) {
+      return false;
+    }
 
-  // [Bit Strings]
-    case 0x1F:
-      sub_execute_bit_strings(vb, opcode);
+    written |= writes[i];
+  }
+
+  return true;
+}
+
+static void record_idle_loop(struct VB_Core* vb, uint32_t addr, uint64_t cycles) {
+  struct VB_IdleLoop* loop = NULL;
+
+  for (uint8_t i = 0; i < vb->idle_loop_count; i++) {
+    if (vb->idle_loops[i].addr == addr) {
+      loop = &vb->idle_loops[i];
       break;
+    }
+  }
+
+  if (!loop) {
+    if (vb->idle_loop_count < VB_IDLE_LOOP_MAX) {
+      loop = &vb->idle_loops[vb->idle_loop_count++];
+    }
+    else {
+      // full, so make room by forgetting the least used one.
+      loop = &vb->idle_loops[0];
+      for (uint8_t i = 1; i < VB_IDLE_LOOP_MAX; i++) {
+        if (vb->idle_loops[i].cycles < loop->cycles) {
+          loop = &vb->idle_loops[i];
+        }
+      }
+    }
+
+    loop->addr = addr;
+    loop->cycles = 0;
+  }
+
+  loop->cycles += cycles;
+}
+
+// called after an idle block has run a full pass, which cost the given cycles.
+// only the passes that would finish before the slice does are skipped, the
+// last one is run for real, as it can see an event that is due part way.
+static void skip_idle_loop(struct VB_Core* vb, const struct VB_Block* block, int32_t cost) {
+  if (vb->cycles_left <= cost || cost <= 0 || vb->timed_read) {
+    return;
+  }
+
+  const uint32_t passes = (vb->cycles_left - 1) / cost;
+  const uint64_t cycles = (uint64_t)passes * cost;
+
+  vb->cycles_left -= cycles;
+  CPU.step_count += (size_t)passes * block->count;
+  record_idle_loop(vb, block->tag & ~1, cycles);
+}
+
+const struct VB_IdleLoop* vb_get_idle_loops(const struct VB_Core* vb, size_t* count) {
+  *count = vb->idle_loop_count;
+  return vb->idle_loops;
+}
+
+
+// [Fusion]
+// a few pairs of instructions turn up together all over game code, such as
+// movhi + movea to build a 32-bit constant, movhi + ld / st for an absolute
+// address, and cmp + bcond. once a block is built, these pairs are given a
+// single id, so the dispatcher runs both for the price of one jump, see
+// [Fused] for the handlers.
+//
+// only the first op of the pair changes, the second is left as it was for
+// anything that looks at them one by one (the jit, idle loops...). a branch
+// into the middle of a pair builds its own block from there, which starts
+// on the second op, so never sees the pair.
 
-  // [CAXI]
-    case 0x3A:
-      vb_log("[CPU] CAXI\tFormat 4\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
+// returns FUSED_COUNT if the pair can't be fused.
+static uint8_t fused_op(const struct VB_DecodedOp* first, const struct VB_DecodedOp* second) {
+  switch (first->opcode) {
+    case 0x2F: // movhi
+      // the second op has to use what movhi built. writing r0 is odd
+      // enough to not bother with, as the second op reads it as zero.
+      if (first->reg2 == ZERO_REGISTER || second->reg1 != first->reg2) {
+        break;
+      }
+
+      switch (second->opcode) {
+        case 0x28: return FUSED_MOVHI_MOVEA;
+        case 0x30: return FUSED_MOVHI_LD_B;
+        case 0x31: return FUSED_MOVHI_LD_H;
+        case 0x33: return FUSED_MOVHI_LD_W;
+        case 0x34: return FUSED_MOVHI_ST_B;
+        case 0x35: return FUSED_MOVHI_ST_H;
+        case 0x37: return FUSED_MOVHI_ST_W;
+      }
       break;
 
-  // [SETF]
-    case 0x12:
-      vb_log("[CPU] SETF\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      assert(!"instruction not implemented!");
+    case 0x03: // cmp reg
+      if ((second->opcode & 0x38) == 0x20) {
+        return FUSED_CMP_REG_BCOND;
+      }
       break;
 
-  // [Nintendo - Standalone]
-    case 0x16:
-      vb_log("[CPU] CLI\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      // assert(!"instruction not implemented!");
-      CLI(vb);
+    case 0x13: // cmp imm
+      if ((second->opcode & 0x38) == 0x20) {
+        return FUSED_CMP_IMM_BCOND;
+      }
       break;
+  }
+
+  return FUSED_COUNT;
+}
+
+static void fuse_block(struct VB_Block* block) {
+  for (uint16_t i = 0; i + 1 < block->count; i++) {
+    const uint8_t fused = fused_op(&block->ops[i], &block->ops[i + 1]);
+
+    if (fused != FUSED_COUNT) {
+      block->ops[i].id = OP_ID_FUSED + fused;
+      i++; // the second op can't start another pair
+    }
+  }
+}
+
+uint64_t vb_get_fusion_hits(const struct VB_Core* vb, enum VB_Fusion fusion) {
+  assert(fusion < VB_Fusion_MAX);
+  return vb->fusion_hits[fusion];
+}
+
+
+// [Blocks]
+// code in rom and wram is run as blocks, a straight line run of decoded
+// instructions that ends on the first branch. once a block has run, it
+// remembers where it jumped to, so a hot loop can go from block to block
+// without ever having to look the next one up.
+static void mark_wram_code(struct VB_Core* vb, uint32_t start, uint32_t end) {
+  const uint32_t first = (start & 0xFFFF) >> VB_WRAM_CODE_PAGE_SHIFT;
+  const uint32_t last = ((end - 1) & 0xFFFF) >> VB_WRAM_CODE_PAGE_SHIFT;
+
+  for (uint32_t page = first; page <= last; page++) {
+    if (!vb->wram_code[page]) {
+      vb->wram_code[page] = true;
+      // writes to it now have to go through the bus, see wram_check_code().
+      vb_bus_protect_wram(vb, page << VB_WRAM_CODE_PAGE_SHIFT);
+    }
+  }
+}
 
-    case 0x1E:
-      vb_log("[CPU] SEI\tFormat 2\tCOUNT [%zu]\n", vb->v810.step_count);
-      // assert(!"instruction not implemented!");
-      SEI(vb);
+static struct VB_Block* build_block(struct VB_Core* vb, struct VB_Block* block, uint32_t addr) {
+  const bool wram = is_wram_addr(addr);
+
+  block->tag = addr | 1;
+  block->count = 0;
+  block->fetches = 0;
+  block->wram = wram;
+  block->next[0] = NULL;
+  block->next[1] = NULL;
+
+  while (block->count < VB_BLOCK_MAX_OPS) {
+    struct VB_DecodedOp* op = &block->ops[block->count++];
+
+    if (wram) {
+      decode(vb, addr, op);
+    }
+    else {
+      struct VB_DecodedOp scratch;
+      *op = *fetch(vb, addr, &scratch);
+    }
+
+    addr += op->size;
+    block->fetches += op->size / 2;
+
+    if (op->flags & VB_OP_FLAG_BRANCH) {
       break;
+    }
 
-    default:
-      assert(!"UNK instruction!");
+    // don't let a wram block wrap around to the start of wram (or its
+    // mirror), it makes invalidating far simpler.
+    if (wram && !(addr & 0xFFFF)) {
       break;
+    }
+  }
+
+  block->end = addr;
+  block->code = NULL;
+  block->idle = is_idle_loop(block);
+  fuse_block(block);
+
+  if (wram) {
+    mark_wram_code(vb, block->tag & ~1, block->end);
+  }
+  #ifdef VB_JIT
+  else {
+    // only rom blocks are compiled, as they can never be invalidated.
+    vb_jit_compile(vb, block);
+  }
+  #endif
+
+  return block;
+}
+
+// returns NULL if the pc is in a region that blocks aren't built for.
+static inline struct VB_Block* find_block(struct VB_Core* vb) {
+  if (VB_UNLIKELY(!is_rom_addr(REG_PC) && !is_wram_addr(REG_PC))) {
+    return NULL;
+  }
+
+  struct VB_Block* block = &vb->blocks[(REG_PC >> 1) & (VB_BLOCK_ENTRIES - 1)];
+
+  if (VB_UNLIKELY(block->tag != (REG_PC | 1))) {
+    build_block(vb, block, REG_PC);
   }
+
+  return block;
+}
+
+// computed goto is a gnu extension, but it lets each op jump straight to the
+// next one, so the branch predictor gets a separate history for every op,
+// rather than everything going through the one indirect jump in a switch.
+#ifndef VB_COMPUTED_GOTO
+  #if defined(__GNUC__) || defined(__clang__)
+    #define VB_COMPUTED_GOTO 1
+  #else
+    #define VB_COMPUTED_GOTO 0
+  #endif
+#endif
+
+#if VB_COMPUTED_GOTO
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+// returns the number of instructions that were executed.
+static uint32_t run_block(struct VB_Core* vb, const struct VB_Block* block) {
+  const uint32_t tag = block->tag;
+  const struct VB_DecodedOp* op = block->ops;
+  const struct VB_DecodedOp* const end = block->ops + block->count;
+  uint32_t next_pc;
+
+#if VB_COMPUTED_GOTO
+  static const void* const dispatch[OP_ID_COUNT] = {
+    #define X(opcode, mnemonic, format, handler, cycles, flags) [opcode] = &&op_##opcode,
+    V810_OPS(X)
+    #undef X
+    #define X(sub, mnemonic, handler, cycles) [OP_ID_FLOAT + sub] = &&float_##sub,
+    V810_FLOAT_OPS(X)
+    #undef X
+    #define X(sub, mnemonic, handler, cycles) [OP_ID_BSTR + sub] = &&bstr_##sub,
+    V810_BSTR_OPS(X)
+    #undef X
+    [OP_ID_UNKNOWN] = &&op_unknown,
+    #define X(name, handler, fusion) [OP_ID_FUSED + FUSED_##name] = &&fused_##name,
+    V810_FUSED_OPS(X)
+    #undef X
+  };
+
+  #define DISPATCH() \
+    next_pc = REG_PC + op->size; \
+    REGISTERS[ZERO_REGISTER] = 0; /* forced to zero */ \
+    REG_PC = next_pc; \
+    vb->cycles_left -= op->cycles; \
+    goto *dispatch[op->id]
+
+  // either the pc was changed (the last op always branches), or the
+  // block overwrote itself, in which case the rest of it is stale.
+  #define NEXT() \
+    op++; \
+    if (VB_UNLIKELY(op == end || REG_PC != next_pc || block->tag != tag)) { \
+      return op - block->ops; \
+    } \
+    DISPATCH()
+
+  DISPATCH();
+
+  #define X(opcode, mnemonic, format, handler, cycles, flags) op_##opcode: handler(vb, op); NEXT();
+  V810_OPS(X)
+  #undef X
+  #define X(sub, mnemonic, handler, cycles) float_##sub: handler(vb, op); NEXT();
+  V810_FLOAT_OPS(X)
+  #undef X
+  #define X(sub, mnemonic, handler, cycles) bstr_##sub: handler(vb, op); NEXT();
+  V810_BSTR_OPS(X)
+  #undef X
+  op_unknown: UNKNOWN(vb, op); NEXT();
+  // the handler has already moved the pc on past the second op.
+  #define X(name, handler, fusion) fused_##name: \
+    handler(vb, op); vb->fusion_hits[fusion]++; next_pc += op[1].size; op++; NEXT();
+  V810_FUSED_OPS(X)
+  #undef X
+
+  #undef DISPATCH
+  #undef NEXT
+#else
+  do {
+    next_pc = REG_PC + op->size;
+    REGISTERS[ZERO_REGISTER] = 0; // forced to zero
+    REG_PC = next_pc;
+    vb->cycles_left -= op->cycles;
+
+    switch (op->id) {
+      #define X(opcode, mnemonic, format, handler, cycles, flags) case opcode: handler(vb, op); break;
+      V810_OPS(X)
+      #undef X
+      #define X(sub, mnemonic, handler, cycles) case OP_ID_FLOAT + sub: handler(vb, op); break;
+      V810_FLOAT_OPS(X)
+      #undef X
+      #define X(sub, mnemonic, handler, cycles) case OP_ID_BSTR + sub: handler(vb, op); break;
+      V810_BSTR_OPS(X)
+      #undef X
+      #define X(name, handler, fusion) case OP_ID_FUSED + FUSED_##name: \
+        handler(vb, op); vb->fusion_hits[fusion]++; next_pc += op[1].size; op++; break;
+      V810_FUSED_OPS(X)
+      #undef X
+      default: UNKNOWN(vb, op); break;
+    }
+
+    op++;
+    // either the pc was changed (the last op always branches), or the
+    // block overwrote itself, in which case the rest of it is stale.
+  } while (op != end && REG_PC == next_pc && block->tag == tag);
+
+  return op - block->ops;
+#endif
 }
 
+#if VB_COMPUTED_GOTO
+  #pragma GCC diagnostic pop
+#endif
+
+#ifdef VB_JIT_DIFF
+// runs the block with the interpreter and then again with the jit from the
+// same starting state, and checks that both end up with the same cpu.
+// wram is restored in between, but io is not, so any io the block does
+// happens twice. this is only meant for finding bugs in the jit!
+static uint32_t run_block_diff(struct VB_Core* vb, const struct VB_Block* block) {
+  static uint8_t wram[sizeof(vb->wram)];
+  struct VB_Cpu before, interp;
+  // io writes in the block can cut the slice short, which has to be undone
+  // too, else the clock goes backwards for the second run. events that were
+  // fired stay fired, so the second run sees them as the first one left them,
+  // which means it may not cut the slice again, so the clock is compared
+  // rather than cycles_left.
+  const uint64_t slice_end_before = vb->sched.slice_end;
+  const int32_t cycles_before = vb->cycles_left;
+
+  memcpy(&before, &CPU, sizeof(before));
+  memcpy(wram, vb->wram, sizeof(wram));
+
+  const uint32_t interp_count = run_block(vb, block);
+  const int32_t interp_cycles = vb->cycles_left;
+  const uint64_t interp_now = vb_now(vb);
+  flags_sync(vb);
+  memcpy(&interp, &CPU, sizeof(interp));
+
+  memcpy(&CPU, &before, sizeof(CPU));
+  memcpy(vb->wram, wram, sizeof(wram));
+  vb->sched.slice_end = slice_end_before;
+  vb->cycles_left = cycles_before;
+  flags_load(vb);
+
+  const uint32_t jit_count = block->code(vb);
+
+  if (interp_count != jit_count || interp_now != vb_now(vb) || memcmp(&interp, &CPU, sizeof(interp))) {
+    vb_log_err("[JIT] mismatch in block: 0x%08X count: %u vs %u\n", block->tag & ~1, interp_count, jit_count);
+    vb_log_err("\tcycles left: %d vs %d\n", interp_cycles, vb->cycles_left);
+    vb_log_err("\tnow: %llu vs %llu\n", (unsigned long long)interp_now, (unsigned long long)vb_now(vb));
+    vb_log_err("\tPC: 0x%08X vs 0x%08X\n", interp.PC, CPU.PC);
+
+    for (size_t i = 0; i < VB_ARR_SIZE(interp.registers); i++) {
+      if (interp.registers[i] != CPU.registers[i]) {
+        vb_log_err("\tr%zu: 0x%08X vs 0x%08X\n", i, interp.registers[i], CPU.registers[i]);
+      }
+    }
+
+    vb_log_err("\tZSOC: %u%u%u%u vs %u%u%u%u\n",
+      interp.PSW.Z, interp.PSW.S, interp.PSW.OV, interp.PSW.CY,
+      CPU.PSW.Z, CPU.PSW.S, CPU.PSW.OV, CPU.PSW.CY);
+
+    vb_log_fatal("[JIT] differential check failed\n");
+  }
+
+  return jit_count;
+}
+#endif
 
+// runs until vb->cycles_left runs out. whole blocks are run at a time, so
+// this usually goes a few cycles over, which is left in cycles_left.
 void vb_v810_run(struct VB_Core* vb) {
-  REGISTERS[ZERO_REGISTER] = 0; // forced to zero
-  execute(vb);
+  struct VB_Block* prev = NULL;
+
+  while (vb->cycles_left > 0) {
+    struct VB_Block* block = NULL;
+
+    if (VB_UNLIKELY(vb->irq_ready || CPU.halted)) {
+      if (vb->irq_ready) {
+        take_interrupt(vb);
+        prev = NULL;
+      }
+      else {
+        // only an interrupt wakes the cpu, and they can only be raised by
+        // an event, the earliest of which is the end of this slice. so the
+        // clock goes straight there without running anything.
+        vb->cycles_left = 0;
+        break;
+      }
+    }
+
+    if (prev) {
+      // the block we just ran ends in a branch, so we are either at
+      // the fall through or wherever it jumped to.
+      const uint8_t slot = REG_PC != prev->end;
+      block = prev->next[slot];
+
+      if (VB_UNLIKELY(!block || block->tag != (REG_PC | 1))) {
+        block = find_block(vb);
+        prev->next[slot] = block;
+      }
+    }
+    else {
+      block = find_block(vb);
+    }
+
+    if (VB_LIKELY(block != NULL)) {
+      const int32_t cycles_before = vb->cycles_left;
+      uint32_t count;
+
+      vb->timed_read = false;
+
+      if (CPU.CHCW & CHCW_ICE) {
+        cache_fetch_range(vb, REG_PC, block->end);
+      }
+      else {
+        vb->cycles_left -= block->fetches * wait_states(vb, REG_PC, VB_Access_FETCH);
+      }
+
+      #if defined(VB_JIT)
+        if (block->code) {
+          // compiled code works on the psw flags directly.
+          flags_sync(vb);
+          #if defined(VB_JIT_DIFF)
+            count = run_block_diff(vb, block);
+          #else
+            count = block->code(vb);
+          #endif
+          flags_load(vb);
+        }
+        else {
+          count = run_block(vb, block);
+        }
+      #else
+        count = run_block(vb, block);
+      #endif
+
+      CPU.step_count += count;
+
+      if (VB_UNLIKELY(block->idle) && REG_PC == (block->tag & ~1)) {
+        skip_idle_loop(vb, block, cycles_before - vb->cycles_left);
+      }
+    }
+    else {
+      execute(vb);
+      CPU.step_count++;
+    }
+
+    prev = block;
+  }
+}
+
+#ifdef VB_JIT
+// the jit calls handlers through this, as they work on the lazy flags,
+// whereas the compiled code around them works on the psw flags.
+void vb_v810_call_handler(struct VB_Core* vb, const struct VB_DecodedOp* op) {
+  flags_load(vb);
+  op->handler(vb, op);
+  flags_sync(vb);
+}
+#endif
+
+void vb_v810_invalidate_wram(struct VB_Core* vb, uint32_t addr) {
+  const uint32_t page = (addr & 0xFFFF) >> VB_WRAM_CODE_PAGE_SHIFT;
+
+  // this is slow, but it only happens when the game writes to a page
+  // of wram that has been run as code, which is rare.
+  for (size_t i = 0; i < VB_ARR_SIZE(vb->blocks); i++) {
+    struct VB_Block* block = &vb->blocks[i];
+
+    if (block->tag && block->wram) {
+      const uint32_t first = (block->tag & 0xFFFF) >> VB_WRAM_CODE_PAGE_SHIFT;
+      const uint32_t last = ((block->end - 1) & 0xFFFF) >> VB_WRAM_CODE_PAGE_SHIFT;
+
+      if (page >= first && page <= last) {
+        block->tag = 0;
+      }
+    }
+  }
+
+  vb->wram_code[page] = false;
+  vb_bus_unprotect_wram(vb, addr);
+}
+
+void vb_v810_flush_cache(struct VB_Core* vb) {
+  memset(vb->predecode, 0, sizeof(vb->predecode));
+  memset(vb->blocks, 0, sizeof(vb->blocks));
+  memset(vb->wram_code, 0, sizeof(vb->wram_code));
+
+  #ifdef VB_JIT
+    vb_jit_flush(vb);
+  #endif
+}
+
+void vb_v810_warm(struct VB_Core* vb, const struct VB_DecodedOp* ops, const uint32_t* blocks, size_t count) {
+  // whatever the cpu has decoded itself is left alone, it's the same op.
+  for (size_t i = 0; ops && i < VB_ARR_SIZE(vb->predecode); i++) {
+    if (ops[i].tag && !vb->predecode[i].tag) {
+      vb->predecode[i] = ops[i];
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    uint32_t addr = blocks[i] & ~1;
+
+    // a block can be cut short before it branches, so the rest of it
+    // is built as well, the same as it would be when it's run.
+    while (is_rom_addr(addr)) {
+      struct VB_Block* block = &vb->blocks[(addr >> 1) & (VB_BLOCK_ENTRIES - 1)];
+
+      if (block->tag) {
+        break;
+      }
 
-  if (CPU.PSW.ID) {
-    // vb_log_fatal("[CPU] ID is set!\tCOUNT [%zu]\n", vb->v810.step_count);
+      build_block(vb, block, addr);
+
+      if (block->ops[block->count - 1].flags & VB_OP_FLAG_BRANCH) {
+        break;
+      }
+
+      addr = block->end;
+    }
   }
 }
 
@@ -1387,4 +2342,88 @@ void vb_v810_reset(struct VB_Core* vb) {
   vb->v810.PSW.NP = 1;
   vb->v810.PIR = 0x00005346;
   vb->v810.registers[ZERO_REGISTER] = 0x00000000;
+  flags_load(vb);
+
+  // sources raise theirs again as they reset.
+  vb->irq_pending = 0;
+  vb->irq_ready = false;
+}
+
+
+// [Disassembler]
+static const char* const BCOND_NAMES[16] = {
+  "bv", "bc", "be", "bnh", "bn", "br", "blt", "ble",
+  "bnv", "bnc", "bne", "bh", "bp", "nop", "bge", "bgt",
+};
+
+uint8_t vb_disassemble(struct VB_Core* vb, uint32_t addr, char* buf, size_t size) {
+  struct VB_DecodedOp op;
+  decode(vb, addr, &op);
+
+  const struct OpInfo* info = op_info(op.id);
+  const char* name = info->mnemonic;
+  const uint32_t pc = align_16(addr);
+
+  switch ((enum V810Format)info->format) {
+    case FORMAT_NONE:
+    case FORMAT_2_BSTR:
+      snprintf(buf, size, "%s", name);
+      break;
+
+    case FORMAT_1:
+    case FORMAT_7:
+      snprintf(buf, size, "%s r%u, r%u", name, op.reg1, op.reg2);
+      break;
+
+    case FORMAT_1_JMP:
+      snprintf(buf, size, "%s [r%u]", name, op.reg1);
+      break;
+
+    case FORMAT_2:
+    case FORMAT_2_SIGNED:
+      snprintf(buf, size, "%s %d, r%u", name, op.imm, op.reg2);
+      break;
+
+    case FORMAT_2_LDSR:
+      snprintf(buf, size, "%s r%u, sr%d", name, op.reg2, op.imm);
+      break;
+
+    case FORMAT_2_STSR:
+      snprintf(buf, size, "%s sr%d, r%u", name, op.imm, op.reg2);
+      break;
+
+    case FORMAT_2_TRAP:
+      snprintf(buf, size, "%s %d", name, op.imm);
+      break;
+
+    case FORMAT_3:
+      snprintf(buf, size, "%s 0x%08X", BCOND_NAMES[op.sub & 0xF], align_16(pc + op.imm));
+      break;
+
+    case FORMAT_4:
+      snprintf(buf, size, "%s 0x%08X", name, align_16(pc + op.imm));
+      break;
+
+    case FORMAT_5:
+      snprintf(buf, size, "%s 0x%04X, r%u, r%u", name, (uint32_t)op.imm, op.reg1, op.reg2);
+      break;
+
+    case FORMAT_5_SIGNED:
+      snprintf(buf, size, "%s %d, r%u, r%u", name, op.imm, op.reg1, op.reg2);
+      break;
+
+    case FORMAT_5_HI:
+      snprintf(buf, size, "%s 0x%04X, r%u, r%u", name, (uint32_t)op.imm >> 16, op.reg1, op.reg2);
+      break;
+
+    case FORMAT_6_LOAD:
+      snprintf(buf, size, "%s %d[r%u], r%u", name, op.imm, op.reg1, op.reg2);
+      break;
+
+    case FORMAT_6_STORE:
+      snprintf(buf, size, "%s r%u, %d[r%u]", name, op.reg2, op.imm, op.reg1);
+      break;
+  }
+
+  return op.size;
 }
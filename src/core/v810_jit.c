@@ -0,0 +1,667 @@
+/**
+ * Copyright 2022 TotalJustice.
+ * SPDX-License-Identifier: MIT
+ */
+
+// needed for MAP_ANONYMOUS
+#define _DEFAULT_SOURCE
+
+#include "vb.h"
+#include "internal.h"
+
+// only built with -Dcpu=jit, the rest of the file is skipped otherwise
+// so that everything in src/core can still be compiled in one go.
+#ifdef VB_JIT
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(__x86_64__)
+  #error "the jit only supports x86-64 (system v abi)"
+#endif
+
+
+/*
+[some notes]
+
+- only blocks built from rom are compiled, rom can't be written to so the
+  code never has to be thrown away (other than when the buffer fills up).
+
+- a handful of the most used v810 registers in a block are kept in host
+  registers (rbp, r12-r15) for the whole block. everything else is loaded
+  from / stored to REGISTERS as needed.
+
+- the simple alu ops, register moves and branches are emitted natively.
+  everything else (load / store, system registers, mul / div, bit strings,
+  floats...) calls the interpreter's handler for that op, with the cached
+  registers flushed before and reloaded after the call.
+
+- the buffer is never writable and executable at the same time, the part
+  that's about to be written to is made writable only while compiling.
+
+- the emitted code follows the interpreter exactly, quirks and all, that
+  way -Djit_diff=true can compare the two after every block.
+*/
+
+enum {
+  JIT_BUFFER_SIZE = 1024 * 1024 * 8, // 8 MiB
+};
+
+enum HostReg {
+  RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+  R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+};
+
+// x86 condition codes, used for setcc / jcc / cmovcc.
+enum HostCond {
+  CC_O = 0x0, CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_S = 0x8,
+};
+
+// rbx always holds the core, these are the callee saved regs left over.
+static const uint8_t CACHE_REGS[] = { RBP, R12, R13, R14, R15 };
+
+#define OFF_REG(n) ((int32_t)(offsetof(struct VB_Core, v810.registers) + sizeof(uint32_t) * (n)))
+#define OFF_PC ((int32_t)offsetof(struct VB_Core, v810.PC))
+#define OFF_Z ((int32_t)offsetof(struct VB_Core, v810.PSW.Z))
+#define OFF_S ((int32_t)offsetof(struct VB_Core, v810.PSW.S))
+#define OFF_OV ((int32_t)offsetof(struct VB_Core, v810.PSW.OV))
+#define OFF_CY ((int32_t)offsetof(struct VB_Core, v810.PSW.CY))
+#define OFF_CYCLES ((int32_t)offsetof(struct VB_Core, cycles_left))
+
+struct Emitter {
+  uint8_t* buf;
+  size_t size;
+  size_t used;
+
+  // host reg each v810 reg is cached in, 0 if not cached.
+  uint8_t cached[32];
+  bool dirty[32];
+
+  // r0 was written to in memory and needs zeroing before the next op.
+  bool r0_dirty;
+
+  // cycles of the ops so far that haven't been taken off cycles_left yet.
+  uint32_t pending_cycles;
+
+  // jumps that need patching to the exit once its address is known.
+  size_t exits[VB_BLOCK_MAX_OPS];
+  size_t exit_count;
+};
+
+
+// [Encoding]
+static void emit8(struct Emitter* e, uint8_t v) {
+  if (e->used < e->size) {
+    e->buf[e->used] = v;
+  }
+  e->used++;
+}
+
+static void emit32(struct Emitter* e, uint32_t v) {
+  for (size_t i = 0; i < 4; i++) {
+    emit8(e, v >> (i * 8));
+  }
+}
+
+static void emit64(struct Emitter* e, uint64_t v) {
+  for (size_t i = 0; i < 8; i++) {
+    emit8(e, v >> (i * 8));
+  }
+}
+
+static void emit_rex(struct Emitter* e, bool w, uint8_t reg, uint8_t rm) {
+  const uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+
+  if (rex != 0x40) {
+    emit8(e, rex);
+  }
+}
+
+static void emit_modrm_reg(struct Emitter* e, uint8_t reg, uint8_t rm) {
+  emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// [rbx + disp32]
+static void emit_modrm_mem(struct Emitter* e, uint8_t reg, int32_t disp) {
+  emit8(e, 0x80 | ((reg & 7) << 3) | RBX);
+  emit32(e, disp);
+}
+
+// op r/m32, r32 (add = 0x01, or = 0x09, and = 0x21, sub = 0x29,
+// xor = 0x31, cmp = 0x39, mov = 0x89)
+static void emit_op_rr(struct Emitter* e, uint8_t opc, uint8_t dst, uint8_t src) {
+  emit_rex(e, false, src, dst);
+  emit8(e, opc);
+  emit_modrm_reg(e, src, dst);
+}
+
+// op r/m32, imm32 (add = 0, or = 1, and = 4, sub = 5, xor = 6, cmp = 7)
+static void emit_op_ri(struct Emitter* e, uint8_t ext, uint8_t dst, int32_t imm) {
+  emit_rex(e, false, 0, dst);
+  emit8(e, 0x81);
+  emit_modrm_reg(e, ext, dst);
+  emit32(e, imm);
+}
+
+static void emit_mov_ri(struct Emitter* e, uint8_t dst, uint32_t imm) {
+  emit_rex(e, false, 0, dst);
+  emit8(e, 0xB8 + (dst & 7));
+  emit32(e, imm);
+}
+
+static void emit_mov_ri64(struct Emitter* e, uint8_t dst, uint64_t imm) {
+  emit_rex(e, true, 0, dst);
+  emit8(e, 0xB8 + (dst & 7));
+  emit64(e, imm);
+}
+
+static void emit_load(struct Emitter* e, uint8_t dst, int32_t off) {
+  emit_rex(e, false, dst, RBX);
+  emit8(e, 0x8B);
+  emit_modrm_mem(e, dst, off);
+}
+
+static void emit_store(struct Emitter* e, int32_t off, uint8_t src) {
+  emit_rex(e, false, src, RBX);
+  emit8(e, 0x89);
+  emit_modrm_mem(e, src, off);
+}
+
+static void emit_store_imm32(struct Emitter* e, int32_t off, uint32_t imm) {
+  emit8(e, 0xC7);
+  emit_modrm_mem(e, 0, off);
+  emit32(e, imm);
+}
+
+static void emit_store_imm8(struct Emitter* e, int32_t off, uint8_t imm) {
+  emit8(e, 0xC6);
+  emit_modrm_mem(e, 0, off);
+  emit8(e, imm);
+}
+
+static void emit_setcc_mem(struct Emitter* e, uint8_t cc, int32_t off) {
+  emit8(e, 0x0F);
+  emit8(e, 0x90 + cc);
+  emit_modrm_mem(e, 0, off);
+}
+
+// movzx eax, byte [rbx + off]
+static void emit_movzx_al(struct Emitter* e, int32_t off) {
+  emit8(e, 0x0F);
+  emit8(e, 0xB6);
+  emit_modrm_mem(e, RAX, off);
+}
+
+// or al, byte [rbx + off] (0x0A) / xor al, byte [rbx + off] (0x32)
+static void emit_op_al_mem(struct Emitter* e, uint8_t opc, int32_t off) {
+  emit8(e, opc);
+  emit_modrm_mem(e, RAX, off);
+}
+
+static void emit_push(struct Emitter* e, uint8_t reg) {
+  emit_rex(e, false, 0, reg);
+  emit8(e, 0x50 + (reg & 7));
+}
+
+static void emit_pop(struct Emitter* e, uint8_t reg) {
+  emit_rex(e, false, 0, reg);
+  emit8(e, 0x58 + (reg & 7));
+}
+
+
+// sub dword [rbx + cycles_left], pending
+static void emit_charge_cycles(struct Emitter* e) {
+  if (e->pending_cycles) {
+    emit8(e, 0x81);
+    emit_modrm_mem(e, 5, OFF_CYCLES);
+    emit32(e, e->pending_cycles);
+    e->pending_cycles = 0;
+  }
+}
+
+
+// [Register cache]
+static void load_guest(struct Emitter* e, uint8_t dst, uint8_t reg) {
+  if (reg == ZERO_REGISTER) {
+    emit_op_rr(e, 0x31, dst, dst); // xor dst, dst
+  }
+  else if (e->cached[reg]) {
+    emit_op_rr(e, 0x89, dst, e->cached[reg]);
+  }
+  else {
+    emit_load(e, dst, OFF_REG(reg));
+  }
+}
+
+// writes to r0 go to memory, same as the interpreter, which only
+// forces it back to zero before the next op.
+static void store_guest(struct Emitter* e, uint8_t reg, uint8_t src) {
+  if (reg == ZERO_REGISTER) {
+    emit_store(e, OFF_REG(reg), src);
+    e->r0_dirty = true;
+  }
+  else if (e->cached[reg]) {
+    emit_op_rr(e, 0x89, e->cached[reg], src);
+    e->dirty[reg] = true;
+  }
+  else {
+    emit_store(e, OFF_REG(reg), src);
+  }
+}
+
+static void flush_guest_regs(struct Emitter* e) {
+  for (uint8_t reg = 1; reg < 32; reg++) {
+    if (e->cached[reg] && e->dirty[reg]) {
+      emit_store(e, OFF_REG(reg), e->cached[reg]);
+      e->dirty[reg] = false;
+    }
+  }
+}
+
+static void reload_guest_regs(struct Emitter* e) {
+  for (uint8_t reg = 1; reg < 32; reg++) {
+    if (e->cached[reg]) {
+      emit_load(e, e->cached[reg], OFF_REG(reg));
+    }
+  }
+}
+
+
+// [Translation]
+static bool is_native(uint8_t opcode) {
+  switch (opcode) {
+    case 0x00: case 0x10: case 0x28: case 0x2F: // MOV / MOVEA / MOVHI
+    case 0x01: case 0x11: case 0x29: // ADD / ADDI
+    case 0x02: case 0x03: case 0x13: // SUB / CMP
+    case 0x0C: case 0x0D: case 0x0E: case 0x0F: // OR / AND / XOR / NOT
+    case 0x2C: case 0x2D: case 0x2E: // ORI / ANDI / XORI
+    case 0x20: case 0x21: case 0x22: case 0x23: // Bcond
+    case 0x24: case 0x25: case 0x26: case 0x27: // Bcond
+    case 0x06: case 0x2A: case 0x2B: // JMP / JR / JAL
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// picks the v810 registers that native ops in the block use the most.
+static void alloc_guest_regs(struct Emitter* e, const struct VB_Block* block) {
+  uint32_t uses[32] = {0};
+
+  for (size_t i = 0; i < block->count; i++) {
+    const struct VB_DecodedOp* op = &block->ops[i];
+
+    if (is_native(op->opcode) && (op->opcode & 0x38) != 0x20) {
+      uses[op->reg1]++;
+      uses[op->reg2]++;
+    }
+  }
+
+  uses[ZERO_REGISTER] = 0;
+  uses[LINK_POINTER] += block->ops[block->count - 1].opcode == 0x2B;
+
+  for (size_t i = 0; i < VB_ARR_SIZE(CACHE_REGS); i++) {
+    uint8_t best = 0;
+
+    for (uint8_t reg = 1; reg < 32; reg++) {
+      if (!e->cached[reg] && uses[reg] > uses[best]) {
+        best = reg;
+      }
+    }
+
+    // not worth keeping a reg that is only touched once.
+    if (uses[best] < 2) {
+      break;
+    }
+
+    e->cached[best] = CACHE_REGS[i];
+  }
+}
+
+static void emit_flags_zsov(struct Emitter* e) {
+  emit_setcc_mem(e, CC_E, OFF_Z);
+  emit_setcc_mem(e, CC_S, OFF_S);
+  emit_setcc_mem(e, CC_O, OFF_OV);
+}
+
+// same as add_internal() / sub_internal()
+static void emit_flags_arith(struct Emitter* e) {
+  emit_flags_zsov(e);
+  emit_setcc_mem(e, CC_B, OFF_CY);
+}
+
+// same as set_bitwise_flags()
+static void emit_flags_bitwise(struct Emitter* e) {
+  emit_setcc_mem(e, CC_E, OFF_Z);
+  emit_setcc_mem(e, CC_S, OFF_S);
+  emit_store_imm8(e, OFF_OV, 0);
+}
+
+// reg2 = reg2 (op) reg1
+static void emit_alu_rr(struct Emitter* e, const struct VB_DecodedOp* op, uint8_t opc, bool arith, bool writeback) {
+  load_guest(e, RAX, op->reg2);
+  load_guest(e, RCX, op->reg1);
+  emit_op_rr(e, opc, RAX, RCX);
+
+  if (arith) {
+    emit_flags_arith(e);
+  }
+  else {
+    emit_flags_bitwise(e);
+  }
+
+  if (writeback) {
+    store_guest(e, op->reg2, RAX);
+  }
+}
+
+// reg2 = src (op) imm
+static void emit_alu_ri(struct Emitter* e, const struct VB_DecodedOp* op, uint8_t ext, uint8_t src, bool arith, bool writeback) {
+  load_guest(e, RAX, src);
+  emit_op_ri(e, ext, RAX, op->imm);
+
+  if (arith) {
+    emit_flags_arith(e);
+  }
+  else {
+    emit_flags_bitwise(e);
+  }
+
+  if (writeback) {
+    store_guest(e, op->reg2, RAX);
+  }
+}
+
+// leaves al as 1 if the branch is taken, same checks as Bcond().
+static void emit_bcond_test(struct Emitter* e, uint8_t cond) {
+  switch (cond & 7) {
+    case 0: emit_movzx_al(e, OFF_OV); break; // V
+    case 1: emit_movzx_al(e, OFF_CY); break; // C
+    case 2: emit_movzx_al(e, OFF_Z); break; // Z
+    case 3: emit_movzx_al(e, OFF_CY); emit_op_al_mem(e, 0x0A, OFF_Z); break; // NH
+    case 4: emit_movzx_al(e, OFF_S); break; // N
+    case 5: emit_mov_ri(e, RAX, 1); break; // T
+    case 6: emit_movzx_al(e, OFF_OV); emit_op_al_mem(e, 0x32, OFF_S); break; // LT
+    case 7: emit_movzx_al(e, OFF_OV); emit_op_al_mem(e, 0x32, OFF_S); emit_op_al_mem(e, 0x0A, OFF_Z); break; // LE
+  }
+
+  // the upper 8 conditions are the inverse of the lower 8.
+  if (cond & 8) {
+    emit8(e, 0x34); emit8(e, 0x01); // xor al, 1
+  }
+}
+
+static void emit_native(struct Emitter* e, const struct VB_DecodedOp* op, uint32_t pc) {
+  switch (op->opcode) {
+    case 0x10: // MOV imm
+      emit_mov_ri(e, RAX, op->imm);
+      store_guest(e, op->reg2, RAX);
+      break;
+
+    case 0x00: // MOV reg
+      load_guest(e, RAX, op->reg1);
+      store_guest(e, op->reg2, RAX);
+      break;
+
+    case 0x28: // MOVEA
+    case 0x2F: // MOVHI (imm is already shifted)
+      load_guest(e, RAX, op->reg1);
+      emit_op_ri(e, 0, RAX, op->imm);
+      store_guest(e, op->reg2, RAX);
+      break;
+
+    case 0x01: emit_alu_rr(e, op, 0x01, true, true); break; // ADD reg
+    case 0x11: emit_alu_ri(e, op, 0, op->reg2, true, true); break; // ADD imm
+    case 0x29: emit_alu_ri(e, op, 0, op->reg2, true, true); break; // ADDI
+    case 0x02: emit_alu_rr(e, op, 0x29, true, true); break; // SUB
+    case 0x03: emit_alu_rr(e, op, 0x39, true, false); break; // CMP reg
+    case 0x13: emit_alu_ri(e, op, 7, op->reg2, true, false); break; // CMP imm
+    case 0x0C: emit_alu_rr(e, op, 0x09, false, true); break; // OR
+    case 0x0D: emit_alu_rr(e, op, 0x21, false, true); break; // AND
+    case 0x0E: emit_alu_rr(e, op, 0x31, false, true); break; // XOR
+    case 0x2C: emit_alu_ri(e, op, 1, op->reg1, false, true); break; // ORI
+    case 0x2D: emit_alu_ri(e, op, 4, op->reg1, false, true); break; // ANDI
+    case 0x2E: emit_alu_ri(e, op, 6, op->reg1, false, true); break; // XORI
+
+    case 0x0F: // NOT
+      load_guest(e, RAX, op->reg1);
+      emit8(e, 0xF7); emit_modrm_reg(e, 2, RAX); // not eax
+      emit_op_rr(e, 0x85, RAX, RAX); // test eax, eax
+      emit_flags_bitwise(e);
+      store_guest(e, op->reg2, RAX);
+      break;
+
+    case 0x20: case 0x21: case 0x22: case 0x23:
+    case 0x24: case 0x25: case 0x26: case 0x27: // Bcond
+      emit_bcond_test(e, op->sub);
+      // taken branches cost 2 more cycles, same as Bcond().
+      emit8(e, 0x0F); emit8(e, 0xB6); emit_modrm_reg(e, RCX, RAX); // movzx ecx, al
+      emit_op_rr(e, 0x01, RCX, RCX); // add ecx, ecx
+      emit8(e, 0x29); emit_modrm_mem(e, RCX, OFF_CYCLES); // sub [cycles_left], ecx
+      emit_mov_ri(e, RCX, pc + op->size);
+      emit_mov_ri(e, RDX, (pc + op->imm) & ~1);
+      emit8(e, 0x84); emit_modrm_reg(e, RAX, RAX); // test al, al
+      emit8(e, 0x0F); emit8(e, 0x45); emit_modrm_reg(e, RCX, RDX); // cmovnz ecx, edx
+      emit_store(e, OFF_PC, RCX);
+      break;
+
+    case 0x2B: // JAL
+      emit_mov_ri(e, RAX, pc + op->size);
+      store_guest(e, LINK_POINTER, RAX);
+      emit_store_imm32(e, OFF_PC, (pc + op->imm) & ~1);
+      break;
+
+    case 0x2A: // JR
+      emit_store_imm32(e, OFF_PC, (pc + op->imm) & ~1);
+      break;
+
+    case 0x06: // JMP
+      load_guest(e, RAX, op->reg1);
+      emit_op_ri(e, 4, RAX, ~1);
+      emit_store(e, OFF_PC, RAX);
+      break;
+
+    default:
+      assert(!"op is not native!");
+      break;
+  }
+}
+
+// calls the interpreter's handler for the op, see vb_v810_call_handler().
+static void emit_fallback(struct Emitter* e, const struct VB_DecodedOp* op, uint32_t pc, uint32_t index, bool last) {
+  flush_guest_regs(e);
+
+  // the handler may read cycles_left (and could leave the block early),
+  // so everything up to and including this op is paid for now.
+  emit_charge_cycles(e);
+
+  // the interpreter forces r0 to zero and has the pc after the op.
+  emit_store_imm32(e, OFF_REG(ZERO_REGISTER), 0);
+  emit_store_imm32(e, OFF_PC, pc + op->size);
+
+  emit_rex(e, true, RBX, RDI); emit8(e, 0x89); emit_modrm_reg(e, RBX, RDI); // mov rdi, rbx
+  emit_mov_ri64(e, RSI, (uintptr_t)op);
+  emit_mov_ri64(e, RAX, (uintptr_t)vb_v810_call_handler);
+  emit8(e, 0xFF); emit_modrm_reg(e, 2, RAX); // call rax
+
+  reload_guest_regs(e);
+  // the handler may have written to r0, which the next op won't see.
+  e->r0_dirty = true;
+
+  // same as run_block(), leave early if the op changed the pc.
+  if (!last) {
+    emit_mov_ri(e, RAX, index + 1);
+    emit8(e, 0x81); emit_modrm_mem(e, 7, OFF_PC); emit32(e, pc + op->size); // cmp [pc], imm
+    emit8(e, 0x0F); emit8(e, 0x80 + CC_NE); // jne exit
+    e->exits[e->exit_count++] = e->used;
+    emit32(e, 0);
+  }
+}
+
+static void patch_exits(struct Emitter* e, size_t target) {
+  for (size_t i = 0; i < e->exit_count; i++) {
+    const size_t at = e->exits[i];
+    const uint32_t rel = target - (at + 4);
+
+    for (size_t j = 0; j < 4 && at + j < e->size; j++) {
+      e->buf[at + j] = rel >> (j * 8);
+    }
+  }
+}
+
+static bool compile(struct VB_Jit* jit, struct VB_Block* block) {
+  struct Emitter e = {0};
+  e.buf = jit->buffer + jit->used;
+  e.size = jit->size - jit->used;
+
+  alloc_guest_regs(&e, block);
+  // the last block may have left a write to r0 behind.
+  e.r0_dirty = true;
+
+  // prologue, 6 pushes + 8 keeps the stack 16 byte aligned for calls.
+  emit_push(&e, RBX);
+  emit_push(&e, RBP);
+  emit_push(&e, R12);
+  emit_push(&e, R13);
+  emit_push(&e, R14);
+  emit_push(&e, R15);
+  emit8(&e, 0x48); emit8(&e, 0x83); emit8(&e, 0xEC); emit8(&e, 0x08); // sub rsp, 8
+  emit_rex(&e, true, RDI, RBX); emit8(&e, 0x89); emit_modrm_reg(&e, RDI, RBX); // mov rbx, rdi
+  reload_guest_regs(&e);
+
+  uint32_t pc = block->tag & ~1;
+  bool branched = false;
+
+  for (uint32_t i = 0; i < block->count; i++) {
+    const struct VB_DecodedOp* op = &block->ops[i];
+    const bool last = i + 1 == block->count;
+
+    e.pending_cycles += op->cycles;
+
+    if (is_native(op->opcode)) {
+      if (e.r0_dirty) {
+        emit_store_imm32(&e, OFF_REG(ZERO_REGISTER), 0);
+        e.r0_dirty = false;
+      }
+
+      emit_native(&e, op, pc);
+    }
+    else {
+      emit_fallback(&e, op, pc, i, last);
+    }
+
+    branched = op->flags & VB_OP_FLAG_BRANCH;
+    pc += op->size;
+  }
+
+  // the block was cut short, so carry on from the next op.
+  if (!branched && is_native(block->ops[block->count - 1].opcode)) {
+    emit_store_imm32(&e, OFF_PC, block->end);
+  }
+
+  flush_guest_regs(&e);
+  emit_charge_cycles(&e);
+  emit_mov_ri(&e, RAX, block->count);
+
+  // early exits jump here with eax already set and no dirty regs.
+  patch_exits(&e, e.used);
+  emit8(&e, 0x48); emit8(&e, 0x83); emit8(&e, 0xC4); emit8(&e, 0x08); // add rsp, 8
+  emit_pop(&e, R15);
+  emit_pop(&e, R14);
+  emit_pop(&e, R13);
+  emit_pop(&e, R12);
+  emit_pop(&e, RBP);
+  emit_pop(&e, RBX);
+  emit8(&e, 0xC3); // ret
+
+  if (e.used > e.size) {
+    return false;
+  }
+
+  // iso c has no cast from a data pointer to a function pointer.
+  const void* code = e.buf;
+  static_assert(sizeof(block->code) == sizeof(code), "function pointers aren't the size of data pointers");
+  memcpy(&block->code, &code, sizeof(block->code));
+  jit->used += e.used;
+  return true;
+}
+
+// protects the buffer from offset (rounded down to a page) to the end.
+static bool protect_from(struct VB_Jit* jit, size_t offset, int prot) {
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t start = offset & ~(page - 1);
+
+  return mprotect(jit->buffer + start, jit->size - start, prot) == 0;
+}
+
+static void drop_blocks(struct VB_Core* vb) {
+  vb_jit_flush(vb);
+
+  for (size_t i = 0; i < VB_ARR_SIZE(vb->blocks); i++) {
+    vb->blocks[i].code = NULL;
+  }
+}
+
+static bool compile_writable(struct VB_Core* vb, struct VB_Block* block) {
+  struct VB_Jit* jit = &vb->jit;
+  const size_t from = jit->used;
+
+  if (!protect_from(jit, from, PROT_READ | PROT_WRITE)) {
+    vb_log_err("[JIT] failed to make code buffer writable\n");
+    return false;
+  }
+
+  const bool compiled = compile(jit, block);
+
+  if (!protect_from(jit, from, PROT_READ | PROT_EXEC)) {
+    // none of what's there can be run now.
+    vb_log_err("[JIT] failed to make code buffer executable\n");
+    drop_blocks(vb);
+    return false;
+  }
+
+  return compiled;
+}
+
+bool vb_jit_compile(struct VB_Core* vb, struct VB_Block* block) {
+  struct VB_Jit* jit = &vb->jit;
+
+  if (!jit->buffer) {
+    void* buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (buffer == MAP_FAILED) {
+      vb_log_err("[JIT] failed to map code buffer\n");
+      return false;
+    }
+
+    jit->buffer = buffer;
+    jit->size = JIT_BUFFER_SIZE;
+    jit->used = 0;
+  }
+
+  if (compile_writable(vb, block)) {
+    return true;
+  }
+
+  // out of space, throw everything away and start again.
+  drop_blocks(vb);
+  return compile_writable(vb, block);
+}
+
+void vb_jit_flush(struct VB_Core* vb) {
+  vb->jit.used = 0;
+}
+
+void vb_jit_quit(struct VB_Core* vb) {
+  if (vb->jit.buffer) {
+    munmap(vb->jit.buffer, vb->jit.size);
+  }
+
+  memset(&vb->jit, 0, sizeof(vb->jit));
+}
+
+#endif // VB_JIT
@@ -0,0 +1,171 @@
+/**
+ * Copyright 2022 TotalJustice.
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+// the v810 instruction set, written once and expanded wherever it's needed
+// (the decoder, the dispatcher and the disassembler), so they can't drift.
+//
+// this is only meant to be included by v810.c, the handler names refer to
+// the static functions in there.
+
+
+// how an instruction is decoded, and how it is shown when disassembled.
+// some formats decode the same way and only differ in how they are shown.
+enum V810Format {
+  FORMAT_NONE,      // no operands
+  FORMAT_1,         // reg1, reg2
+  FORMAT_1_JMP,     // [reg1]
+  FORMAT_2,         // imm5 (zero extended), reg2
+  FORMAT_2_SIGNED,  // imm5 (sign extended), reg2
+  FORMAT_2_LDSR,    // reg2, system register
+  FORMAT_2_STSR,    // system register, reg2
+  FORMAT_2_TRAP,    // vector
+  FORMAT_2_BSTR,    // bit string, subop in the lo5 bits
+  FORMAT_3,         // cond, disp9
+  FORMAT_4,         // disp26
+  FORMAT_5,         // imm16 (zero extended), reg1, reg2
+  FORMAT_5_SIGNED,  // imm16 (sign extended), reg1, reg2
+  FORMAT_5_HI,      // imm16 << 16, reg1, reg2
+  FORMAT_6_LOAD,    // disp16[reg1], reg2
+  FORMAT_6_STORE,   // reg2, disp16[reg1]
+  FORMAT_7,         // reg1, reg2, subop in the second halfword
+};
+
+// X(opcode, mnemonic, format, handler, cycles, flags)
+// every one of the 64 primary opcodes has an entry, in order.
+// cycles are the base cost, wait states are added on top of these.
+// taken branches cost 2 more, which Bcond charges itself.
+#define V810_OPS(X) \
+  X(0x00, "mov",    FORMAT_1,         MOV_reg,       1,  0) \
+  X(0x01, "add",    FORMAT_1,         ADD_reg,       1,  0) \
+  X(0x02, "sub",    FORMAT_1,         SUB_reg,       1,  0) \
+  X(0x03, "cmp",    FORMAT_1,         CMP_reg,       1,  0) \
+  X(0x04, "shl",    FORMAT_1,         SHL,           1,  0) \
+  X(0x05, "shr",    FORMAT_1,         SHR,           1,  0) \
+  X(0x06, "jmp",    FORMAT_1_JMP,     JMP,           3,  VB_OP_FLAG_BRANCH) \
+  X(0x07, "sar",    FORMAT_1,         SAR,           1,  0) \
+  X(0x08, "mul",    FORMAT_1,         MUL,           13, 0) \
+  X(0x09, "div",    FORMAT_1,         UNIMPLEMENTED, 38, 0) \
+  X(0x0A, "mulu",   FORMAT_1,         MULU,          13, 0) \
+  X(0x0B, "divu",   FORMAT_1,         UNIMPLEMENTED, 36, 0) \
+  X(0x0C, "or",     FORMAT_1,         OR,            1,  0) \
+  X(0x0D, "and",    FORMAT_1,         AND,           1,  0) \
+  X(0x0E, "xor",    FORMAT_1,         XOR,           1,  0) \
+  X(0x0F, "not",    FORMAT_1,         NOT,           1,  0) \
+  X(0x10, "mov",    FORMAT_2_SIGNED,  MOV_imm,       1,  0) \
+  X(0x11, "add",    FORMAT_2_SIGNED,  ADD_imm,       1,  0) \
+  X(0x12, "setf",   FORMAT_2,         SETF,          1,  0) \
+  X(0x13, "cmp",    FORMAT_2_SIGNED,  CMP_imm,       1,  0) \
+  X(0x14, "shl",    FORMAT_2,         SHLI,          1,  0) \
+  X(0x15, "shr",    FORMAT_2,         SHRI,          1,  0) \
+  X(0x16, "cli",    FORMAT_NONE,      CLI,           12, 0) \
+  X(0x17, "sar",    FORMAT_2,         SARI,          1,  0) \
+  X(0x18, "trap",   FORMAT_2_TRAP,    TRAP,          15, VB_OP_FLAG_BRANCH) \
+  X(0x19, "reti",   FORMAT_NONE,      RETI,          10, VB_OP_FLAG_BRANCH) \
+  X(0x1A, "halt",   FORMAT_NONE,      HALT,          1,  VB_OP_FLAG_BRANCH) \
+  X(0x1B, "???",    FORMAT_NONE,      UNKNOWN,       1,  VB_OP_FLAG_BRANCH) \
+  X(0x1C, "ldsr",   FORMAT_2_LDSR,    LDSR,          8,  0) \
+  X(0x1D, "stsr",   FORMAT_2_STSR,    STSR,          8,  0) \
+  X(0x1E, "sei",    FORMAT_NONE,      SEI,           12, 0) \
+  X(0x1F, "bstr",   FORMAT_2_BSTR,    UNKNOWN,       1,  0) \
+  X(0x20, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x21, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x22, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x23, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x24, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x25, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x26, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x27, "b",      FORMAT_3,         Bcond,         1,  VB_OP_FLAG_BRANCH) \
+  X(0x28, "movea",  FORMAT_5_SIGNED,  MOVEA,         1,  0) \
+  X(0x29, "addi",   FORMAT_5_SIGNED,  ADDI,          1,  0) \
+  X(0x2A, "jr",     FORMAT_4,         JR,            3,  VB_OP_FLAG_BRANCH) \
+  X(0x2B, "jal",    FORMAT_4,         JAL,           3,  VB_OP_FLAG_BRANCH) \
+  X(0x2C, "ori",    FORMAT_5,         ORI,           1,  0) \
+  X(0x2D, "andi",   FORMAT_5,         ANDI,          1,  0) \
+  X(0x2E, "xori",   FORMAT_5,         XORI,          1,  0) \
+  X(0x2F, "movhi",  FORMAT_5_HI,      MOVHI,         1,  0) \
+  X(0x30, "ld.b",   FORMAT_6_LOAD,    LD_B,          5,  0) \
+  X(0x31, "ld.h",   FORMAT_6_LOAD,    LD_H,          5,  0) \
+  X(0x32, "???",    FORMAT_NONE,      UNKNOWN,       1,  VB_OP_FLAG_BRANCH) \
+  X(0x33, "ld.w",   FORMAT_6_LOAD,    LD_W,          5,  0) \
+  X(0x34, "st.b",   FORMAT_6_STORE,   ST_B,          4,  0) \
+  X(0x35, "st.h",   FORMAT_6_STORE,   ST_H,          4,  0) \
+  X(0x36, "???",    FORMAT_NONE,      UNKNOWN,       1,  VB_OP_FLAG_BRANCH) \
+  X(0x37, "st.w",   FORMAT_6_STORE,   ST_W,          4,  0) \
+  X(0x38, "in.b",   FORMAT_6_LOAD,    IN_B,          5,  0) \
+  X(0x39, "in.h",   FORMAT_6_LOAD,    IN_H,          5,  0) \
+  X(0x3A, "caxi",   FORMAT_6_LOAD,    UNIMPLEMENTED, 26, 0) \
+  X(0x3B, "in.w",   FORMAT_6_LOAD,    IN_W,          5,  0) \
+  X(0x3C, "out.b",  FORMAT_6_STORE,   OUT_B,         4,  0) \
+  X(0x3D, "out.h",  FORMAT_6_STORE,   OUT_H,         4,  0) \
+  X(0x3E, "fpp",    FORMAT_7,         UNKNOWN,       1,  0) \
+  X(0x3F, "out.w",  FORMAT_6_STORE,   OUT_W,         4,  0)
+
+// X(subop, mnemonic, handler, cycles)
+// [Floating-Point] and [Nintendo - Extended], opcode 0x3E.
+#define V810_FLOAT_OPS(X) \
+  X(0x00, "cmpf.s", CMPF_S,        10) \
+  X(0x02, "cvt.ws", CVT_WS,        16) \
+  X(0x03, "cvt.sw", CVT_SW,        14) \
+  X(0x04, "addf.s", ADDF_S,        28) \
+  X(0x05, "subf.s", SUBF_S,        28) \
+  X(0x06, "mulf.s", MULF_S,        30) \
+  X(0x07, "divf.s", DIVF_S,        44) \
+  X(0x08, "xb",     XB,            6) \
+  X(0x09, "xh",     XH,            1) \
+  X(0x0A, "rev",    REV,           22) \
+  X(0x0B, "trnc.s", TRNC_S,        14) \
+  X(0x0C, "mpyhw",  MPYHW,         9)
+
+// X(subop, mnemonic, handler, cycles)
+// [Bit Strings], opcode 0x1F.
+// these take longer the more bits they touch, this is just the setup cost,
+// see [Bit Strings] in v810.c for the rest.
+#define V810_BSTR_OPS(X) \
+  X(0x00, "sch0bsu",SCH0BSU,       20) \
+  X(0x01, "sch0bsd",SCH0BSD,       20) \
+  X(0x02, "sch1bsu",SCH1BSU,       20) \
+  X(0x03, "sch1bsd",SCH1BSD,       20) \
+  X(0x08, "orbsu",  BSTR_BITWISE,  20) \
+  X(0x09, "andbsu", BSTR_BITWISE,  20) \
+  X(0x0A, "xorbsu", BSTR_BITWISE,  20) \
+  X(0x0B, "movbsu", BSTR_BITWISE,  20) \
+  X(0x0C, "ornbsu", BSTR_BITWISE,  20) \
+  X(0x0D, "andnbsu",BSTR_BITWISE,  20) \
+  X(0x0E, "xornbsu",BSTR_BITWISE,  20) \
+  X(0x0F, "notbsu", BSTR_BITWISE,  20)
+
+// X(name, handler, fusion)
+// pairs of instructions that blocks run as one, see [Fusion] in v810.c.
+// the handler runs both, fusion is the VB_Fusion that it counts towards.
+#define V810_FUSED_OPS(X) \
+  X(MOVHI_MOVEA,    MOVHI_MOVEA,    VB_Fusion_MOVHI_MOVEA) \
+  X(MOVHI_LD_B,     MOVHI_LD_B,     VB_Fusion_MOVHI_LOAD) \
+  X(MOVHI_LD_H,     MOVHI_LD_H,     VB_Fusion_MOVHI_LOAD) \
+  X(MOVHI_LD_W,     MOVHI_LD_W,     VB_Fusion_MOVHI_LOAD) \
+  X(MOVHI_ST_B,     MOVHI_ST_B,     VB_Fusion_MOVHI_STORE) \
+  X(MOVHI_ST_H,     MOVHI_ST_H,     VB_Fusion_MOVHI_STORE) \
+  X(MOVHI_ST_W,     MOVHI_ST_W,     VB_Fusion_MOVHI_STORE) \
+  X(CMP_REG_BCOND,  CMP_reg_Bcond,  VB_Fusion_CMP_BCOND) \
+  X(CMP_IMM_BCOND,  CMP_imm_Bcond,  VB_Fusion_CMP_BCOND)
+
+enum V810FusedOp {
+  #define X(name, handler, fusion) FUSED_##name,
+  V810_FUSED_OPS(X)
+  #undef X
+  FUSED_COUNT,
+};
+
+// every decoded op has an id, which is what the dispatcher jumps on.
+// the primary opcodes use their opcode as the id, the subops come after,
+// then the fused pairs, which only blocks use.
+enum V810OpId {
+  OP_ID_FLOAT = 64, // + float subop
+  OP_ID_BSTR = OP_ID_FLOAT + 16, // + bit string subop
+  OP_ID_UNKNOWN = OP_ID_BSTR + 16, // invalid subops
+  OP_ID_FUSED, // + V810FusedOp
+  OP_ID_COUNT = OP_ID_FUSED + FUSED_COUNT,
+};
@@ -15,6 +15,29 @@ static bool is_pow2(size_t size) {
   return (!(size & (size - 1)) && size);
 }
 
+// fnv-1a, this isn't for security, only to tell roms / files apart.
+static uint64_t hash_bytes(const void* data, size_t size, uint64_t hash) {
+  const uint8_t* bytes = data;
+
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ULL;
+  }
+
+  return hash;
+}
+
+// fnv-1a offset basis.
+static const uint64_t HASH_INIT = 0xCBF29CE484222325ULL;
+
+static uint64_t cache_checksum(const struct VB_CacheHeader* header, const uint32_t* blocks) {
+  struct VB_CacheHeader copy = *header;
+  copy.checksum = 0;
+
+  const uint64_t hash = hash_bytes(&copy, sizeof(copy), HASH_INIT);
+  return hash_bytes(blocks, header->block_count * sizeof(*blocks), hash);
+}
+
 static void log_header(const struct VB_RomHeader* header) {
   assert(header);
 
@@ -34,8 +57,28 @@ void vb_init(struct VB_Core* vb) {
   memset(vb, 0, sizeof(struct VB_Core));
 }
 
+void vb_quit(struct VB_Core* vb) {
+  assert(vb);
+  vb_analysis_free(vb);
+  vb_vip_quit(vb);
+
+  #ifdef VB_JIT
+    vb_jit_quit(vb);
+  #endif
+}
+
 void vb_reset(struct VB_Core* vb) {
+  // the rom may have changed and wram is about to be, so nothing
+  // that has been decoded so far can be trusted.
+  vb_v810_flush_cache(vb);
+  // anything the analysis found is put back on the next run.
+  vb->analysis_pending = vb->analysis != NULL;
   vb_v810_reset(vb);
+  // components add their events as they reset, so this goes first.
+  vb_scheduler_reset(vb, 0);
+  vb->idle_loop_count = 0;
+  memset(vb->fusion_hits, 0, sizeof(vb->fusion_hits));
+  memset(&vb->icache, 0, sizeof(vb->icache));
   vb_vip_reset(vb);
   vb_vsu_reset(vb);
   vb_timer_reset(vb);
@@ -57,9 +100,13 @@ void vb_reset(struct VB_Core* vb) {
   vb->timer.TLR = 0xFF; // 0b11111111
   vb->timer.THR = 0xFF; // 0b11111111
   vb->timer.TCR = 0xE4; // 0b11100100
+  vb->timer.counter = 0xFFFF;
 
   vb->pak.WCR = 0xFC; // 0b11111100
   vb->pak.SCR = 0x4C; // 0b01001100
+
+  vb_bus_map(vb);
+  vb_bus_update_waits(vb);
 }
 
 const struct VB_RomHeader* vb_get_rom_header(const struct VB_Core* vb) {
@@ -106,11 +153,16 @@ bool vb_loadrom(
     assert(header->reserved[i] == 0 && "reserved bytes in header should be zero!");
   }
 
+  // the thread may still be reading the old rom.
+  vb_analysis_free(vb);
+
   vb->rom = data;
   vb->rom_size = size;
   vb->rom_mask = size - 1;
+  vb->rom_hash = 0;
 
   vb_reset(vb);
+  vb_analysis_start(vb);
 
   return true;
 }
@@ -123,6 +175,9 @@ bool vb_savestate(
   state->meta.size = VB_StateMeta_SIZE;
   state->meta.reserved = 0;
 
+  // the psw flags may not have been worked out yet.
+  vb_v810_sync_flags(vb);
+
   memcpy(&state->v810, &vb->v810, sizeof(state->v810));
   memcpy(&state->vip, &vb->vip, sizeof(state->vip));
   memcpy(&state->vsu, &vb->vsu, sizeof(state->vsu));
@@ -131,6 +186,7 @@ bool vb_savestate(
   memcpy(&state->link, &vb->link, sizeof(state->link));
   memcpy(&state->pak, &vb->pak, sizeof(state->pak));
   memcpy(&state->wram, &vb->wram, sizeof(state->wram));
+  state->clock = vb_now(vb);
 
   return true;
 }
@@ -163,6 +219,128 @@ bool vb_loadstate(
   memcpy(&vb->link, &state->link, sizeof(vb->link));
   memcpy(&vb->pak, &state->pak, sizeof(vb->pak));
   memcpy(&vb->wram, &state->wram, sizeof(vb->wram));
+  vb_v810_load_flags(vb);
+
+  // any blocks built from wram are now stale.
+  vb_v810_flush_cache(vb);
+  vb->analysis_pending = vb->analysis != NULL;
+  vb_bus_map(vb);
+  vb_bus_update_waits(vb);
+  memset(vb->icache.tags, 0, sizeof(vb->icache.tags));
+  memset(vb->vip_cache.char_valid, 0, sizeof(vb->vip_cache.char_valid));
+  vb->vip_cache.obj_bins_valid = false;
+
+  // the heap isn't saved, each component knows when it's next due.
+  vb_scheduler_reset(vb, state->clock);
+  vb_vip_schedule(vb);
+  vb_vsu_schedule(vb);
+  vb_timer_schedule(vb);
+
+  // the lines aren't saved, the sources raise them again from their state.
+  vb->irq_pending = 0;
+  vb_vip_update_irq(vb);
+  vb_timer_update_irq(vb);
+  vb_v810_update_irq(vb);
+
+  return true;
+}
+
+uint64_t vb_get_rom_hash(
+  struct VB_Core* vb
+) {
+  assert(vb->rom);
+
+  // only worked out when asked for, as it reads the whole rom.
+  if (!vb->rom_hash) {
+    vb->rom_hash = hash_bytes(vb->rom, vb->rom_size, HASH_INIT) | 1;
+  }
+
+  return vb->rom_hash;
+}
+
+static uint32_t count_rom_blocks(const struct VB_Core* vb) {
+  uint32_t count = 0;
+
+  for (size_t i = 0; i < VB_ARR_SIZE(vb->blocks); i++) {
+    count += vb->blocks[i].tag && !vb->blocks[i].wram;
+  }
+
+  return count;
+}
+
+size_t vb_get_cache_size(
+  const struct VB_Core* vb
+) {
+  return sizeof(struct VB_CacheHeader) + count_rom_blocks(vb) * sizeof(uint32_t);
+}
+
+bool vb_savecache(
+  struct VB_Core* vb, void* data, size_t size
+) {
+  struct VB_CacheHeader header = {0};
+
+  if (size < vb_get_cache_size(vb)) {
+    vb_log_err("[CACHE] buffer too small: got: %zu want: %zu\n", size, vb_get_cache_size(vb));
+    return false;
+  }
+
+  uint32_t* blocks = (uint32_t*)((uint8_t*)data + sizeof(header));
+
+  // wram blocks are left out, wram won't hold the same code next time.
+  for (size_t i = 0; i < VB_ARR_SIZE(vb->blocks); i++) {
+    if (vb->blocks[i].tag && !vb->blocks[i].wram) {
+      blocks[header.block_count++] = vb->blocks[i].tag & ~1;
+    }
+  }
+
+  header.magic = VB_CacheMeta_MAGIC;
+  header.version = VB_CacheMeta_VERSION;
+  header.rom_hash = vb_get_rom_hash(vb);
+  header.checksum = cache_checksum(&header, blocks);
+  memcpy(data, &header, sizeof(header));
+
+  return true;
+}
+
+bool vb_loadcache(
+  struct VB_Core* vb, const void* data, size_t size
+) {
+  const struct VB_CacheHeader* header = data;
+  const uint32_t* blocks = (const uint32_t*)(header + 1);
+
+  assert(((uintptr_t)data & 3) == 0 && "cache has to be 4-byte aligned");
+
+  if (size < sizeof(*header)) {
+    vb_log_err("[CACHE] too small: %zu\n", size);
+    return false;
+  }
+  if (header->magic != VB_CacheMeta_MAGIC) {
+    vb_log_err("[CACHE] bad magic: got: 0x%08X want: 0x%08X\n", header->magic, VB_CacheMeta_MAGIC);
+    return false;
+  }
+  if (header->version != VB_CacheMeta_VERSION) {
+    vb_log_err("[CACHE] bad version: got: 0x%08X want: 0x%08X\n", header->version, VB_CacheMeta_VERSION);
+    return false;
+  }
+  if (header->rom_hash != vb_get_rom_hash(vb)) {
+    vb_log_err("[CACHE] made from a different rom\n");
+    return false;
+  }
+  if (header->reserved != 0) {
+    vb_log_err("[CACHE] bad reserved: got: 0x%08X want: 0x%08X\n", header->reserved, 0);
+    return false;
+  }
+  if ((size - sizeof(*header)) / sizeof(*blocks) != header->block_count) {
+    vb_log_err("[CACHE] bad size: got: %zu blocks: %u\n", size, header->block_count);
+    return false;
+  }
+  if (header->checksum != cache_checksum(header, blocks)) {
+    vb_log_err("[CACHE] bad checksum\n");
+    return false;
+  }
+
+  // these were built from this rom before, so they're known to be code.
+  vb_v810_warm(vb, NULL, blocks, header->block_count);
 
   return true;
 }
@@ -170,13 +348,33 @@ bool vb_loadstate(
 #define HZ (1000000)
 #define CYCLES_PER_FRAME ((20 * HZ) / 50)
 
-void vb_step(struct VB_Core* vb) {
-  uint8_t cycles = 4;
+void vb_run_cycles(struct VB_Core* vb, uint32_t budget) {
+  struct VB_Scheduler* s = &vb->sched;
+
+  // this carries on from where the last run should have stopped, so
+  // whatever the cpu ran over by is taken off this one.
+  s->target += budget;
+
+  if (VB_UNLIKELY(vb->analysis_pending)) {
+    vb_analysis_apply(vb);
+  }
+
+  while (vb_now(vb) < s->target) {
+    const uint64_t now = vb_now(vb);
+    const uint64_t next = vb_scheduler_next(vb);
+
+    // the cpu runs freely until something else needs to happen.
+    uint64_t until = VB_MIN(next, s->target);
+    until = VB_MIN(until, now + INT32_MAX);
+
+    s->slice_end = until;
+    vb->cycles_left = (int32_t)(until - now);
 
-  for (size_t i = 0; i < CYCLES_PER_FRAME; i += cycles) {
     vb_v810_run(vb);
-    vb_vip_run(vb, cycles);
-    vb_vsu_run(vb, cycles);
-    vb->v810.step_count++;
+    vb_scheduler_fire(vb);
   }
 }
+
+void vb_step(struct VB_Core* vb) {
+  vb_run_cycles(vb, CYCLES_PER_FRAME);
+}
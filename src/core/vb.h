@@ -14,8 +14,11 @@ extern "C" {
 
 
 void vb_init(struct VB_Core* vb);
+void vb_quit(struct VB_Core* vb);
 void vb_reset(struct VB_Core* vb);
 void vb_step(struct VB_Core* vb);
+// runs for (at least) the number of cpu cycles given.
+void vb_run_cycles(struct VB_Core* vb, uint32_t budget);
 
 bool vb_loadrom(
   struct VB_Core* vb, const uint8_t* data, size_t size
@@ -29,6 +32,29 @@ bool vb_loadstate(
   struct VB_Core* vb, const struct VB_State* state
 );
 
+// hash of the rom passed to vb_loadrom(), for naming files made from it.
+uint64_t vb_get_rom_hash(
+  struct VB_Core* vb
+);
+
+// size of the buffer that vb_savecache() needs right now.
+size_t vb_get_cache_size(
+  const struct VB_Core* vb
+);
+
+// saves where the rom blocks that have been built so far start, so that a
+// later run of the same rom can build them up front, see VB_CacheHeader.
+bool vb_savecache(
+  struct VB_Core* vb, void* data, size_t size
+);
+
+// call after vb_loadrom(), data has to be 4-byte aligned.
+// returns false (and does nothing) if the cache is for a different rom,
+// a different version, or is corrupt. reset / loadstate empty it again.
+bool vb_loadcache(
+  struct VB_Core* vb, const void* data, size_t size
+);
+
 const struct VB_RomHeader* vb_get_rom_header(
   const struct VB_Core* vb
 );
@@ -45,6 +71,48 @@ void vb_get_rom_title_from_header(
   const struct VB_RomHeader* header, struct VB_RomTitle* title
 );
 
+// loops that the cpu has skipped because they were waiting on something
+// outside of the cpu, with how many cycles were skipped for each.
+const struct VB_IdleLoop* vb_get_idle_loops(
+  const struct VB_Core* vb, size_t* count
+);
+
+// how many times the pair of instructions was run as one by the
+// interpreter, this doesn't count blocks run by the jit.
+uint64_t vb_get_fusion_hits(
+  const struct VB_Core* vb, enum VB_Fusion fusion
+);
+
+// words fetched through the instruction cache that were already in it
+// (hits), and that had to be read from the bus (misses).
+void vb_get_cache_stats(
+  const struct VB_Core* vb, uint64_t* hits, uint64_t* misses
+);
+
+// walks the rom for code when one is loaded, the cpu's caches are then
+// filled with what it found. this only takes effect on the next vb_loadrom().
+void vb_set_analysis(
+  struct VB_Core* vb, enum VB_AnalysisMode mode
+);
+
+// the blocks and functions the rom analysis found, these stay valid until
+// the next vb_loadrom(). returns false if it's off or hasn't finished yet.
+bool vb_get_rom_analysis(
+  const struct VB_Core* vb, struct VB_RomAnalysis* analysis
+);
+
+// draws the right eye on a thread of its own while the left eye is drawn,
+// the frame buffers come out the same either way. does nothing when built
+// without threads. the thread is stopped by vb_quit().
+void vb_set_vip_threads(
+  struct VB_Core* vb, bool enable
+);
+
+// writes the instruction at addr as text, returns its size in bytes.
+uint8_t vb_disassemble(
+  struct VB_Core* vb, uint32_t addr, char* buf, size_t size
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,38 @@
 // #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
+
+#ifdef VB_THREADS
+  #include <pthread.h>
+#endif
+
+// the background kernels use sse2 (x86-64 always has it) or avx2 if the
+// compiler is allowed to, -DVB_VIP_SIMD=0 forces the plain c ones.
+#ifndef VB_VIP_SIMD
+  #if defined(__AVX2__)
+    #define VB_VIP_SIMD 2
+  #elif defined(__SSE2__) || defined(_M_X64)
+    #define VB_VIP_SIMD 1
+  #else
+    #define VB_VIP_SIMD 0
+  #endif
+#endif
+
+// the affine kernel needs the avx2 gathers, which don't have an sse2
+// version. gcc / clang build it for avx2 either way, and it's used if the
+// cpu has avx2, see vb_vip_reset().
+#if VB_VIP_SIMD && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+  #define VB_VIP_AVX2 1
+#else
+  #define VB_VIP_AVX2 0
+#endif
+
+#if VB_VIP_SIMD >= 2 || VB_VIP_AVX2
+  #include <immintrin.h>
+#elif VB_VIP_SIMD
+  #include <emmintrin.h>
+#endif
 
 
 static void vip_log_region(struct VB_Core* vb, uint32_t addr) {
@@ -98,6 +130,72 @@ static void vip_log_region(struct VB_Core* vb, uint32_t addr) {
   }
 }
 
+enum VipInterrupt {
+  VIP_INT_SCANERR = 1 << 0,
+  VIP_INT_LFBEND = 1 << 1,
+  VIP_INT_RFBEND = 1 << 2,
+  VIP_INT_GAMESTART = 1 << 3,
+  VIP_INT_FRAMESTART = 1 << 4,
+  VIP_INT_SBHIT = 1 << 13,
+  VIP_INT_XPEND = 1 << 14,
+  VIP_INT_TIMEERR = 1 << 15,
+};
+
+enum VipDisplay {
+  VIP_DP_RST = 1 << 0, // DPCTRL only
+  VIP_DP_DISP = 1 << 1,
+  VIP_DP_BSY_L0 = 1 << 2, // DPSTTS only, these are the fb being shown
+  VIP_DP_BSY_R0 = 1 << 3,
+  VIP_DP_BSY_L1 = 1 << 4,
+  VIP_DP_BSY_R1 = 1 << 5,
+  VIP_DP_SCANRDY = 1 << 6, // DPSTTS only
+  VIP_DP_FCLK = 1 << 7, // DPSTTS only
+  VIP_DP_RE = 1 << 8,
+  VIP_DP_SYNCE = 1 << 9,
+  VIP_DP_LOCK = 1 << 10,
+};
+
+enum VipDrawing {
+  VIP_XP_RST = 1 << 0, // XPCTRL only
+  VIP_XP_EN = 1 << 1,
+  VIP_XP_BSY0 = 1 << 2, // XPSTTS only, the fb being drawn to
+  VIP_XP_BSY1 = 1 << 3,
+};
+
+// [Timing]
+// the display runs at 50hz whatever the game does, each 20ms frame goes:
+// - frame start, and if it's the start of a game frame, drawing starts.
+// - drawing ends (the time is a guess), the frame is drawn all at once
+//   here, see [Drawing].
+// - the left eye is shown over 3ms-8ms, then the right eye over 13ms-18ms.
+//
+// the vip asks to be run at each of these, and nothing in between.
+// everything the cpu can read only changes on one of these, so a loop
+// polling the status registers can be skipped to the next one.
+enum VipFrameEvent {
+  VIP_FRAME_START,
+  VIP_DRAW_END,
+  VIP_LEFT_START,
+  VIP_LEFT_END,
+  VIP_FRAME_HALF,
+  VIP_RIGHT_START,
+  VIP_RIGHT_END,
+};
+
+enum {
+  VIP_CYCLES_PER_MS = VB_CPU_SPEED / 1000,
+};
+
+static const uint32_t VIP_FRAME_EVENT_CYCLES[] = {
+  [VIP_FRAME_START] = 0,
+  [VIP_DRAW_END] = VIP_CYCLES_PER_MS * 2 + VIP_CYCLES_PER_MS * 8 / 10,
+  [VIP_LEFT_START] = VIP_CYCLES_PER_MS * 3,
+  [VIP_LEFT_END] = VIP_CYCLES_PER_MS * 8,
+  [VIP_FRAME_HALF] = VIP_CYCLES_PER_MS * 10,
+  [VIP_RIGHT_START] = VIP_CYCLES_PER_MS * 13,
+  [VIP_RIGHT_END] = VIP_CYCLES_PER_MS * 18,
+};
+
 static inline uint16_t* vip_get_character_table(struct VB_Core* vb, uint8_t num) {
   assert(num <= 3 && "bruh what are you doing");
 
@@ -108,18 +206,163 @@ static inline uint16_t* vip_get_character_table(struct VB_Core* vb, uint8_t num)
   return vb->vip.vram + (offset >> 1);
 }
 
+// [Characters]
+// everything is drawn from 8x8 characters, 2 bits per pixel, where each
+// row is a halfword with the leftmost pixel in the low bits. a character
+// is decoded the first time it's drawn, then again only after a write to
+// it, see vip_write_16(). the tables aren't mapped for writes for this.
+static void vip_decode_character(struct VB_Core* vb, uint16_t num) {
+  const uint16_t* rows = vip_get_character_table(vb, num >> 9) + (num & 0x1FF) * 8;
+  uint8_t (*out)[8][8] = vb->vip_cache.chars[num];
+
+  for (uint8_t y = 0; y < 8; y++) {
+    for (uint8_t x = 0; x < 8; x++) {
+      const uint8_t pixel = (rows[y] >> (x * 2)) & 0x3;
+      out[0][y][x] = pixel;
+      out[1][y][7 - x] = pixel;
+    }
+  }
+
+  vb->vip_cache.char_valid[num] = true;
+}
+
+// returns the 8 pixels of the row (0-7) of the character, flipped as asked.
+static inline const uint8_t* vip_character_row(struct VB_Core* vb, uint16_t num, bool hflip, bool vflip, uint8_t y) {
+  if (VB_UNLIKELY(!vb->vip_cache.char_valid[num])) {
+    vip_decode_character(vb, num);
+  }
+
+  return vb->vip_cache.chars[num][hflip][vflip ? 7 - y : y];
+}
+
+// offset is anywhere within the character in the table (0-3).
+static inline void vip_invalidate_character(struct VB_Core* vb, uint8_t table, uint32_t offset) {
+  vb->vip_cache.char_valid[(table << 9) | ((offset & 0x1FFF) >> 4)] = false;
+}
+
+// [Objects]
+// objects are binned by the 8 row blocks of the screen that they're on
+// (they're 8 rows high, so 1 or 2), for each eye they're shown on. a block
+// is then drawn from only the objects on it. vip_write_16() moves an
+// object between bins when its rows or eyes change, oam isn't mapped for
+// writes for this.
+enum {
+  OBJECT_ATTRIBUTES = 0x1E000 / 2, // in halfwords from the start of dram
+
+  OBJECT_JLON = 1 << 15,
+  OBJECT_JRON = 1 << 14,
+};
+
+// jy is 8 bits, anything past the bottom of the screen is above it.
+static inline int32_t vip_object_y(const uint16_t* attr) {
+  const uint8_t jy = attr[2];
+  return jy >= VB_VIP_HEIGHT ? jy - 256 : jy;
+}
+
+// adds the object to (or removes it from) the bins of the blocks it's on.
+static void vip_bin_object(struct VB_Core* vb, uint16_t num, bool add) {
+  const uint16_t* attr = vb->vip.dram + OBJECT_ATTRIBUTES + num * 4;
+  const int32_t y = vip_object_y(attr);
+  const uint64_t bit = 1ULL << (num & 63);
+
+  if (y + 7 < 0) {
+    return;
+  }
+
+  for (uint8_t eye = 0; eye < 2; eye++) {
+    // JLON then JRON.
+    if (!(attr[1] & (OBJECT_JLON >> eye))) {
+      continue;
+    }
+
+    for (int32_t block = VB_MAX(y, 0) / 8; block <= VB_MIN(y + 7, VB_VIP_HEIGHT - 1) / 8; block++) {
+      uint64_t* bins = &vb->vip_cache.obj_bins[eye][block][num / 64];
+      *bins = add ? (*bins | bit) : (*bins & ~bit);
+    }
+  }
+}
+
+static void vip_bin_objects(struct VB_Core* vb) {
+  memset(vb->vip_cache.obj_bins, 0, sizeof(vb->vip_cache.obj_bins));
+
+  for (uint16_t num = 0; num < VB_VIP_OBJECTS; num++) {
+    vip_bin_object(vb, num, true);
+  }
+
+  vb->vip_cache.obj_bins_valid = true;
+}
+
 static uint16_t vip_VER_read(struct VB_Core* vb) {
   return vb->vip.VER;
 }
 
+static uint16_t vip_DPSTTS_read(struct VB_Core* vb) {
+  uint16_t value = (vb->vip.DPCTRL & (VIP_DP_DISP | VIP_DP_RE | VIP_DP_SYNCE | VIP_DP_LOCK)) | VIP_DP_SCANRDY;
+
+  // where we are in the frame is whatever happens next, see [Timing].
+  const uint8_t next = vb->vip.frame_event;
+
+  if (next >= VIP_DRAW_END && next <= VIP_FRAME_HALF) {
+    value |= VIP_DP_FCLK;
+  }
+
+  if (vb->vip.DPCTRL & VIP_DP_DISP) {
+    // the pair that isn't being drawn to is the one being shown.
+    const uint16_t shift = vb->vip.frame_buffer ? 0 : 2;
+
+    if (next == VIP_LEFT_END) {
+      value |= VIP_DP_BSY_L0 << shift;
+    }
+    else if (next == VIP_RIGHT_END) {
+      value |= VIP_DP_BSY_R0 << shift;
+    }
+  }
+
+  return value;
+}
+
+static uint16_t vip_XPSTTS_read(struct VB_Core* vb) {
+  uint16_t value = vb->vip.XPCTRL & VIP_XP_EN;
+
+  if (vb->vip.drawing) {
+    value |= vb->vip.frame_buffer ? VIP_XP_BSY1 : VIP_XP_BSY0;
+  }
+
+  return value;
+}
+
+static void vip_DPCTRL_write(struct VB_Core* vb, uint16_t value) {
+  vb->vip.DPCTRL = value & (VIP_DP_DISP | VIP_DP_RE | VIP_DP_SYNCE | VIP_DP_LOCK);
+
+  if (value & VIP_DP_RST) {
+    vb->vip.INTPND &= ~(VIP_INT_SCANERR | VIP_INT_LFBEND | VIP_INT_RFBEND | VIP_INT_GAMESTART | VIP_INT_FRAMESTART | VIP_INT_TIMEERR);
+    vb_vip_update_irq(vb);
+  }
+}
+
+static void vip_XPCTRL_write(struct VB_Core* vb, uint16_t value) {
+  vb->vip.XPCTRL = value & 0x1F02; // SBCMP and XPEN
+
+  if (value & VIP_XP_RST) {
+    vb->vip.INTPND &= ~(VIP_INT_SBHIT | VIP_INT_XPEND | VIP_INT_TIMEERR);
+    vb->vip.drawing = false;
+    vb_vip_update_irq(vb);
+  }
+}
+
+static void vip_FRMCYC_write(struct VB_Core* vb, uint16_t value) {
+  vb->vip.FRMCYC = value & 0xF;
+  vb_vip_schedule(vb);
+}
+
 static uint16_t vip_io_read_16(struct VB_Core* vb, uint32_t addr) {
   assert(!(addr & 0x1) && "unaligned addr in vip_io_write_16!");
 
   switch (addr) {
-    case 0x0005F800: vb_log_fatal("[VIP] read from INTPND Interrupt Pending\n"); break; // INTPND Interrupt Pending
-    case 0x0005F802: vb_log_fatal("[VIP] read from INTENB Interrupt Enable\n"); break; // INTENB Interrupt Enable
+    case 0x0005F800: return vb->vip.INTPND; // INTPND Interrupt Pending
+    case 0x0005F802: return vb->vip.INTENB; // INTENB Interrupt Enable
     case 0x0005F804: vb_log_fatal("[VIP] read from INTCLR Interrupt Clear\n"); break; // INTCLR Interrupt Clear
-    case 0x0005F820: printf("[VIP] read from DPSTTS Display Control Read Register\n"); return 0xFFFF; break; // DPSTTS Display Control Read Register
+    case 0x0005F820: return vip_DPSTTS_read(vb); // DPSTTS Display Control Read Register
     case 0x0005F822: vb_log_fatal("[VIP] read from DPCTRL Display Control Write Register\n"); break; // DPCTRL Display Control Write Register
     case 0x0005F824: vb_log_fatal("[VIP] read from BRTA Brightness Control Register A\n"); break; // BRTA Brightness Control Register A
     case 0x0005F826: vb_log_fatal("[VIP] read from BRTB Brightness Control Register B\n"); break; // BRTB Brightness Control Register B
@@ -127,7 +370,7 @@ static uint16_t vip_io_read_16(struct VB_Core* vb, uint32_t addr) {
     case 0x0005F82A: vb_log_fatal("[VIP] read from REST Rest Control Register\n"); break; // REST Rest Control Register
     case 0x0005F82E: vb_log_fatal("[VIP] read from FRMCYC Game Frame Control Register\n"); break; // FRMCYC Game Frame Control Register
     case 0x0005F830: vb_log_fatal("[VIP] read from CTA Column Table Read Start Address\n"); break; // CTA Column Table Read Start Address
-    case 0x0005F840: printf("[VIP] read from XPSTTS Drawing Control Read Register\n"); break; // XPSTTS Drawing Control Read Register
+    case 0x0005F840: return vip_XPSTTS_read(vb); // XPSTTS Drawing Control Read Register
     case 0x0005F842: vb_log_fatal("[VIP] read from XPCTRL Drawing Control Write Register\n"); break; // XPCTRL Drawing Control Write Register
     case 0x0005F844: vb_log_fatal("[VIP] read from VER VIP Version Register\n"); return vip_VER_read(vb); break; // VER VIP Version Register
     case 0x0005F848: vb_log_fatal("[VIP] read from SPT0 OBJ Control Register 0\n"); break; // SPT0 OBJ Control Register 0
@@ -156,32 +399,32 @@ static void vip_io_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
 
   switch (addr) {
     case 0x0005F800: vb_log_fatal("[VIP] write to INTPND Interrupt Pending: addr: 0x%08X value: 0x%04X\n", addr, value); break; // INTPND Interrupt Pending
-    case 0x0005F802: printf("[VIP] write to INTENB Interrupt Enable: addr: 0x%08X value: 0x%04X\n", addr, value); break; // INTENB Interrupt Enable
-    case 0x0005F804: printf("[VIP] write to INTCLR Interrupt Clear: addr: 0x%08X value: 0x%04X\n", addr, value); break; // INTCLR Interrupt Clear
+    case 0x0005F802: printf("[VIP] write to INTENB Interrupt Enable: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.INTENB = value & 0xE01F; vb_vip_update_irq(vb); break; // INTENB Interrupt Enable
+    case 0x0005F804: printf("[VIP] write to INTCLR Interrupt Clear: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.INTPND &= ~value; vb_vip_update_irq(vb); break; // INTCLR Interrupt Clear
     case 0x0005F820: vb_log_fatal("[VIP] write to DPSTTS Display Control Read Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // DPSTTS Display Control Read Register
-    case 0x0005F822: printf("[VIP] write to DPCTRL Display Control Write Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // DPCTRL Display Control Write Register
+    case 0x0005F822: printf("[VIP] write to DPCTRL Display Control Write Register: addr: 0x%08X value: 0x%04X\n", addr, value); vip_DPCTRL_write(vb, value); break; // DPCTRL Display Control Write Register
     case 0x0005F824: printf("[VIP] write to BRTA Brightness Control Register A: addr: 0x%08X value: 0x%04X\n", addr, value); break; // BRTA Brightness Control Register A
     case 0x0005F826: printf("[VIP] write to BRTB Brightness Control Register B: addr: 0x%08X value: 0x%04X\n", addr, value); break; // BRTB Brightness Control Register B
     case 0x0005F828: printf("[VIP] write to BRTC Brightness Control Register C: addr: 0x%08X value: 0x%04X\n", addr, value); break; // BRTC Brightness Control Register C
     case 0x0005F82A: printf("[VIP] write to REST Rest Control Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // REST Rest Control Register
-    case 0x0005F82E: printf("[VIP] write to FRMCYC Game Frame Control Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // FRMCYC Game Frame Control Register
+    case 0x0005F82E: printf("[VIP] write to FRMCYC Game Frame Control Register: addr: 0x%08X value: 0x%04X\n", addr, value); vip_FRMCYC_write(vb, value); break; // FRMCYC Game Frame Control Register
     case 0x0005F830: printf("[VIP] write to CTA Column Table Read Start Address: addr: 0x%08X value: 0x%04X\n", addr, value); break; // CTA Column Table Read Start Address
     case 0x0005F840: printf("[VIP] write to XPSTTS Drawing Control Read Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // XPSTTS Drawing Control Read Register
-    case 0x0005F842: printf("[VIP] write to XPCTRL Drawing Control Write Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // XPCTRL Drawing Control Write Register
+    case 0x0005F842: printf("[VIP] write to XPCTRL Drawing Control Write Register: addr: 0x%08X value: 0x%04X\n", addr, value); vip_XPCTRL_write(vb, value); break; // XPCTRL Drawing Control Write Register
     case 0x0005F844: printf("[VIP] write to VER VIP Version Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // VER VIP Version Register
-    case 0x0005F848: printf("[VIP] write to SPT0 OBJ Control Register 0: addr: 0x%08X value: 0x%04X\n", addr, value); break; // SPT0 OBJ Control Register 0
-    case 0x0005F84A: printf("[VIP] write to SPT1 OBJ Control Register 1: addr: 0x%08X value: 0x%04X\n", addr, value); break; // SPT1 OBJ Control Register 1
-    case 0x0005F84C: printf("[VIP] write to SPT2 OBJ Control Register 2: addr: 0x%08X value: 0x%04X\n", addr, value); break; // SPT2 OBJ Control Register 2
-    case 0x0005F84E: printf("[VIP] write to SPT3 OBJ Control Register 3: addr: 0x%08X value: 0x%04X\n", addr, value); break; // SPT3 OBJ Control Register 3
-    case 0x0005F860: printf("[VIP] write to GPLT0 BG Palette Control Register 0: addr: 0x%08X value: 0x%04X\n", addr, value); break; // GPLT0 BG Palette Control Register 0
-    case 0x0005F862: printf("[VIP] write to GPLT1 BG Palette Control Register 1: addr: 0x%08X value: 0x%04X\n", addr, value); break; // GPLT1 BG Palette Control Register 1
-    case 0x0005F864: printf("[VIP] write to GPLT2 BG Palette Control Register 2: addr: 0x%08X value: 0x%04X\n", addr, value); break; // GPLT2 BG Palette Control Register 2
-    case 0x0005F866: printf("[VIP] write to GPLT3 BG Palette Control Register 3: addr: 0x%08X value: 0x%04X\n", addr, value); break; // GPLT3 BG Palette Control Register 3
-    case 0x0005F868: printf("[VIP] write to JPLT0 OBJ Palette Control Register 0: addr: 0x%08X value: 0x%04X\n", addr, value); break; // JPLT0 OBJ Palette Control Register 0
-    case 0x0005F86A: printf("[VIP] write to JPLT1 OBJ Palette Control Register 1: addr: 0x%08X value: 0x%04X\n", addr, value); break; // JPLT1 OBJ Palette Control Register 1
-    case 0x0005F86C: printf("[VIP] write to JPLT2 OBJ Palette Control Register 2: addr: 0x%08X value: 0x%04X\n", addr, value); break; // JPLT2 OBJ Palette Control Register 2
-    case 0x0005F86E: printf("[VIP] write to JPLT3 OBJ Palette Control Register 3: addr: 0x%08X value: 0x%04X\n", addr, value); break; // JPLT3 OBJ Palette Control Register 3
-    case 0x0005F870: printf("[VIP] write to BKCOL BG Color Palette Control Register: addr: 0x%08X value: 0x%04X\n", addr, value); break; // BKCOL BG Color Palette Control Register
+    case 0x0005F848: printf("[VIP] write to SPT0 OBJ Control Register 0: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.SPT0 = value & 0x3FF; break; // SPT0 OBJ Control Register 0
+    case 0x0005F84A: printf("[VIP] write to SPT1 OBJ Control Register 1: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.SPT1 = value & 0x3FF; break; // SPT1 OBJ Control Register 1
+    case 0x0005F84C: printf("[VIP] write to SPT2 OBJ Control Register 2: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.SPT2 = value & 0x3FF; break; // SPT2 OBJ Control Register 2
+    case 0x0005F84E: printf("[VIP] write to SPT3 OBJ Control Register 3: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.SPT3 = value & 0x3FF; break; // SPT3 OBJ Control Register 3
+    case 0x0005F860: printf("[VIP] write to GPLT0 BG Palette Control Register 0: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.GPLT0 = value & 0xFC; break; // GPLT0 BG Palette Control Register 0
+    case 0x0005F862: printf("[VIP] write to GPLT1 BG Palette Control Register 1: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.GPLT1 = value & 0xFC; break; // GPLT1 BG Palette Control Register 1
+    case 0x0005F864: printf("[VIP] write to GPLT2 BG Palette Control Register 2: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.GPLT2 = value & 0xFC; break; // GPLT2 BG Palette Control Register 2
+    case 0x0005F866: printf("[VIP] write to GPLT3 BG Palette Control Register 3: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.GPLT3 = value & 0xFC; break; // GPLT3 BG Palette Control Register 3
+    case 0x0005F868: printf("[VIP] write to JPLT0 OBJ Palette Control Register 0: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.JPLT0 = value & 0xFC; break; // JPLT0 OBJ Palette Control Register 0
+    case 0x0005F86A: printf("[VIP] write to JPLT1 OBJ Palette Control Register 1: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.JPLT1 = value & 0xFC; break; // JPLT1 OBJ Palette Control Register 1
+    case 0x0005F86C: printf("[VIP] write to JPLT2 OBJ Palette Control Register 2: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.JPLT2 = value & 0xFC; break; // JPLT2 OBJ Palette Control Register 2
+    case 0x0005F86E: printf("[VIP] write to JPLT3 OBJ Palette Control Register 3: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.JPLT3 = value & 0xFC; break; // JPLT3 OBJ Palette Control Register 3
+    case 0x0005F870: printf("[VIP] write to BKCOL BG Color Palette Control Register: addr: 0x%08X value: 0x%04X\n", addr, value); vb->vip.BKCOL = value & 0x3; break; // BKCOL BG Color Palette Control Register
     default:
         vb_log_fatal("[VIP] invalid register write: 0x%08X value: 0x%04X\n", addr, value);
         break;
@@ -191,6 +434,7 @@ static void vip_io_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
 uint16_t vip_read_16(struct VB_Core* vb, uint32_t addr) {
   assert(!(addr & 0x1) && "unaligned addr in vip_read_16!");
 
+  vb_sync(vb, VB_Event_VIP);
   vip_log_region(vb, addr);
 
   addr &= 0x7FFFF; // the entire region is mirrored
@@ -234,6 +478,7 @@ uint8_t vip_read_8(struct VB_Core* vb, uint32_t addr) {
 void vip_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
   assert(!(addr & 0x1) && "unaligned addr in vip_write_16!");
 
+  vb_sync(vb, VB_Event_VIP);
   vip_log_region(vb, addr);
 
   addr &= 0x7FFFF; // the entire region is mirrored
@@ -241,12 +486,29 @@ void vip_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
   switch ((addr >> 17) & 0x3) {
     case 0:
       vb->vip.vram[addr >> 1] = value;
-      break;
 
-    case 1:
-      vb->vip.dram[(addr & 0x1FFFF) >> 1] = value;
+      // 0x6000 - 0x7FFF of each 32 KiB is a character table.
+      if ((addr & 0x6000) == 0x6000) {
+        vip_invalidate_character(vb, addr >> 15, addr);
+      }
       break;
 
+    case 1: {
+      const uint32_t index = (addr & 0x1FFFF) >> 1;
+      // the eyes (attr[1]) and rows (attr[2]) are what decide the bins.
+      const bool rebin = index >= OBJECT_ATTRIBUTES && ((index & 3) == 1 || (index & 3) == 2) && vb->vip_cache.obj_bins_valid;
+
+      if (rebin) {
+        vip_bin_object(vb, (index - OBJECT_ATTRIBUTES) / 4, false);
+      }
+
+      vb->vip.dram[index] = value;
+
+      if (rebin) {
+        vip_bin_object(vb, (index - OBJECT_ATTRIBUTES) / 4, true);
+      }
+    } break;
+
     case 2:
       vip_io_write_16(vb, addr, value);
       break;
@@ -256,6 +518,7 @@ void vip_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
         const uint8_t num = (addr >> 13) & 0x3;
         uint16_t* character_table = vip_get_character_table(vb, num);
         character_table[(addr & 0x1FFF) >> 1] = value;
+        vip_invalidate_character(vb, num, addr);
       }
       break;
   }
@@ -281,8 +544,830 @@ void vip_write_8(struct VB_Core* vb, uint32_t addr, uint8_t value) {
   }
 }
 
-void vb_vip_run(struct VB_Core* vb, uint8_t cycles) {
+// [Drawing]
+// when drawing is enabled, the whole frame is drawn at once when drawing
+// ends, into the pair of frame buffers that it was drawing to.
+// each eye is drawn into its own buffer a pixel per byte, worlds from 31
+// down to 0 (so 0 is on top), then packed into its frame buffer.
+enum {
+  WORLD_LON = 1 << 15,
+  WORLD_RON = 1 << 14,
+  WORLD_OVR = 1 << 7,
+  WORLD_END = 1 << 6,
+
+  // in halfwords from the start of dram.
+  WORLD_ATTRIBUTES = 0x1D800 / 2,
+  BG_MAP_CELLS = 64 * 64,
+};
+
+enum VipWorldMode {
+  VIP_WORLD_NORMAL,
+  VIP_WORLD_HBIAS, // each row has its own x offset for each eye
+  VIP_WORLD_AFFINE, // each row has its own start and step
+  VIP_WORLD_OBJ, // draws the next group of objects
+};
+
+enum VipEye {
+  VIP_EYE_LEFT,
+  VIP_EYE_RIGHT,
+};
+
+// a world's attributes, as the ones that are signed are sign extended.
+struct VipWorld {
+  uint16_t header;
+  uint8_t mode; // VipWorldMode
+  uint8_t scx; // the background is (1 << scx) maps wide
+  uint8_t scy; // and (1 << scy) maps high
+  uint8_t map; // first map of the background
+  int32_t gx, gp, gy; // where it's drawn on screen
+  int32_t mx, mp, my; // where it's drawn from in the background
+  int32_t w, h; // size - 1
+  uint16_t param; // in halfwords from the start of dram
+  uint16_t overplane; // cell used outside of the background, if OVR
+};
+
+static void vip_get_world(struct VB_Core* vb, uint8_t num, struct VipWorld* world) {
+  const uint16_t* attr = vb->vip.dram + WORLD_ATTRIBUTES + num * 16;
+
+  world->header = attr[0];
+  world->mode = (attr[0] >> 12) & 0x3;
+  world->scx = (attr[0] >> 10) & 0x3;
+  world->scy = (attr[0] >> 8) & 0x3;
+  world->map = attr[0] & 0xF;
+  world->gx = bit_sign_extend(9, attr[1]);
+  world->gp = bit_sign_extend(9, attr[2]);
+  world->gy = (int16_t)attr[3];
+  world->mx = bit_sign_extend(12, attr[4]);
+  world->mp = bit_sign_extend(14, attr[5]);
+  world->my = bit_sign_extend(12, attr[6]);
+  world->w = bit_sign_extend(12, attr[7]);
+  world->h = attr[8];
+  world->param = attr[9];
+  world->overplane = attr[10];
+}
+
+// the cell at the pixel (x, y) of the background.
+static inline uint16_t vip_bg_cell(struct VB_Core* vb, const struct VipWorld* world, int32_t x, int32_t y) {
+  const int32_t width = 512 << world->scx;
+  const int32_t height = 512 << world->scy;
+
+  if ((world->header & WORLD_OVR) && (x < 0 || x >= width || y < 0 || y >= height)) {
+    return world->overplane;
+  }
+
+  // otherwise it repeats forever.
+  x &= width - 1;
+  y &= height - 1;
+
+  const uint8_t map = (world->map + ((y >> 9) << world->scx) + (x >> 9)) & 0xF;
+  return vb->vip.dram[map * BG_MAP_CELLS + ((y >> 3) & 63) * 64 + ((x >> 3) & 63)];
+}
+
+// the params of h-bias and affine worlds can be anywhere in dram.
+static inline uint16_t vip_param(struct VB_Core* vb, const struct VipWorld* world, uint32_t index) {
+  return vb->vip.dram[(world->param + index) & 0xFFFF];
+}
+
+// draws a pixel of a cell, index 0 is always see through.
+static inline void vip_draw_pixel(uint8_t* out, uint8_t pixel, uint8_t palette) {
+  if (pixel) {
+    *out = (palette >> (pixel * 2)) & 0x3;
+  }
+}
+
+#if VB_VIP_SIMD
+// the colour of each pixel index (0-3) in the palette, 0 for index 0.
+static inline __m128i vip_colour_128(__m128i index, uint8_t palette) {
+  const __m128i c1 = _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(1)), _mm_set1_epi8((palette >> 2) & 0x3));
+  const __m128i c2 = _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(2)), _mm_set1_epi8((palette >> 4) & 0x3));
+  const __m128i c3 = _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(3)), _mm_set1_epi8((palette >> 6) & 0x3));
+  return _mm_or_si128(c1, _mm_or_si128(c2, c3));
+}
+
+// a where mask is set, else b.
+static inline __m128i vip_select_128(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
+
+// [Kernels]
+// these blend a character row (8 pixel indices) into a row of an eye,
+// with the palette applied, index 0 being see through. the x2 versions
+// draw the same row into both eyes, each at its own x (the parallax).
+static inline void vip_blend_8(uint8_t* dst, const uint8_t* pixels, uint8_t palette) {
+  #if VB_VIP_SIMD
+    const __m128i index = _mm_loadl_epi64((const __m128i*)pixels);
+    const __m128i see_through = _mm_cmpeq_epi8(index, _mm_setzero_si128());
+    const __m128i colour = vip_colour_128(index, palette);
+    const __m128i old = _mm_loadl_epi64((const __m128i*)dst);
+
+    _mm_storel_epi64((__m128i*)dst, vip_select_128(see_through, old, colour));
+  #else
+    for (uint8_t i = 0; i < 8; i++) {
+      vip_draw_pixel(&dst[i], pixels[i], palette);
+    }
+  #endif
+}
+
+static inline void vip_blend_8x2(uint8_t* left, uint8_t* right, const uint8_t* pixels, uint8_t palette) {
+  #if VB_VIP_SIMD
+    // left eye in the low 8 bytes, right eye in the high 8.
+    const __m128i row = _mm_loadl_epi64((const __m128i*)pixels);
+    const __m128i index = _mm_unpacklo_epi64(row, row);
+    const __m128i see_through = _mm_cmpeq_epi8(index, _mm_setzero_si128());
+    const __m128i colour = vip_colour_128(index, palette);
+    const __m128i old = _mm_unpacklo_epi64(
+      _mm_loadl_epi64((const __m128i*)left), _mm_loadl_epi64((const __m128i*)right)
+    );
+    const __m128i result = vip_select_128(see_through, old, colour);
+
+    _mm_storel_epi64((__m128i*)left, result);
+    _mm_storel_epi64((__m128i*)right, _mm_srli_si128(result, 8));
+  #else
+    for (uint8_t i = 0; i < 8; i++) {
+      vip_draw_pixel(&left[i], pixels[i], palette);
+      vip_draw_pixel(&right[i], pixels[i], palette);
+    }
+  #endif
+}
+
+#if VB_VIP_SIMD >= 2
+// two characters next to each other into both eyes, 32 pixels at once.
+static inline void vip_blend_16x2(
+  uint8_t* left, uint8_t* right,
+  const uint8_t* pixels_a, uint8_t palette_a, const uint8_t* pixels_b, uint8_t palette_b
+) {
+  const __m128i row = _mm_unpacklo_epi64(
+    _mm_loadl_epi64((const __m128i*)pixels_a), _mm_loadl_epi64((const __m128i*)pixels_b)
+  );
+  const __m256i index = _mm256_broadcastsi128_si256(row);
+  const __m256i see_through = _mm256_cmpeq_epi8(index, _mm256_setzero_si256());
+  const __m256i old = _mm256_inserti128_si256(
+    _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)left)), _mm_loadu_si128((const __m128i*)right), 1
+  );
+
+  // each character has its own palette, so the colours are per 8 bytes.
+  __m256i colour = _mm256_setzero_si256();
+
+  for (uint8_t i = 1; i < 4; i++) {
+    const int64_t a = (int64_t)(((palette_a >> (i * 2)) & 0x3) * 0x0101010101010101ULL);
+    const int64_t b = (int64_t)(((palette_b >> (i * 2)) & 0x3) * 0x0101010101010101ULL);
+    const __m256i match = _mm256_cmpeq_epi8(index, _mm256_set1_epi8((char)i));
+    colour = _mm256_or_si256(colour, _mm256_and_si256(match, _mm256_set_epi64x(b, a, b, a)));
+  }
+
+  const __m256i result = _mm256_blendv_epi8(colour, old, see_through);
+
+  _mm_storeu_si128((__m128i*)left, _mm256_castsi256_si128(result));
+  _mm_storeu_si128((__m128i*)right, _mm256_extracti128_si256(result, 1));
+}
+#endif
+
+// draws count pixels of the background from (x, y) going right, a
+// character row at a time. h-bias rows are a normal row that has been
+// moved along, so the characters line up and can be blended whole.
+static void vip_draw_bg_row(
+  struct VB_Core* vb, const struct VipWorld* world, const uint8_t* palettes,
+  uint8_t* out, int32_t count, int32_t x, int32_t y
+) {
+  int32_t i = 0;
+
+  while (i < count) {
+    const uint16_t cell = vip_bg_cell(vb, world, x + i, y);
+    const uint8_t* row = vip_character_row(vb, cell & 0x7FF, cell & 0x2000, cell & 0x1000, y & 7);
+    const uint8_t palette = palettes[cell >> 14];
+
+    if (((x + i) & 7) == 0 && count - i >= 8) {
+      vip_blend_8(&out[i], row, palette);
+      i += 8;
+      continue;
+    }
+
+    for (uint8_t px = (x + i) & 7; px < 8 && i < count; px++, i++) {
+      vip_draw_pixel(&out[i], row[px], palette);
+    }
+  }
+}
+
+#if VB_VIP_AVX2
+// draws count pixels of an affine row, 8 at a time, see vip_draw_affine_row().
+// the cells come from a gather of the bg maps (masked, so that anything
+// outside of the background is the overplane if OVR is set), then the
+// pixels from a gather of the character cache.
+__attribute__((target("avx2")))
+static void vip_draw_affine_row_avx2(
+  struct VB_Core* vb, const struct VipWorld* world, const uint8_t* palettes,
+  uint8_t* out, int32_t count, int32_t x, int32_t y, int32_t dx, int32_t dy
+) {
+  const int32_t width = 512 << world->scx;
+  const int32_t height = 512 << world->scy;
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ovr = _mm256_set1_epi32((world->header & WORLD_OVR) ? -1 : 0);
+  const __m256i overplane = _mm256_set1_epi32(world->overplane);
+  const __m128i scx = _mm_cvtsi32_si128(world->scx);
+  // all 4 palettes, a byte each, picked from with a shift.
+  const __m256i palette = _mm256_set1_epi32((int32_t)(
+    palettes[0] | (palettes[1] << 8) | (palettes[2] << 16) | ((uint32_t)palettes[3] << 24)
+  ));
+  // these read 4 bytes for each lane, the arrays are padded for the last
+  // one and the extra bytes are masked off.
+  const int* const dram = (const void*)vb->vip.dram;
+  const int* const chars = (const void*)vb->vip_cache.chars;
+  const int* const valid = (const void*)vb->vip_cache.char_valid;
+
+  __m256i vx = _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dx)));
+  __m256i vy = _mm256_add_epi32(_mm256_set1_epi32(y), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dy)));
+
+  for (int32_t i = 0; i < count; i += 8) {
+    const __m256i todo = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lane);
+    const __m256i bx = _mm256_srai_epi32(vx, 9);
+    const __m256i by = _mm256_srai_epi32(vy, 9);
+
+    // the same as vip_bg_cell().
+    const __m256i inside = _mm256_and_si256(
+      _mm256_cmpeq_epi32(_mm256_and_si256(bx, _mm256_set1_epi32(~(width - 1))), zero),
+      _mm256_cmpeq_epi32(_mm256_and_si256(by, _mm256_set1_epi32(~(height - 1))), zero)
+    );
+    const __m256i from_map = _mm256_andnot_si256(_mm256_andnot_si256(inside, ovr), todo);
+    const __m256i wx = _mm256_and_si256(bx, _mm256_set1_epi32(width - 1));
+    const __m256i wy = _mm256_and_si256(by, _mm256_set1_epi32(height - 1));
+    const __m256i map = _mm256_and_si256(_mm256_add_epi32(_mm256_set1_epi32(world->map), _mm256_add_epi32(
+      _mm256_sll_epi32(_mm256_srli_epi32(wy, 9), scx), _mm256_srli_epi32(wx, 9)
+    )), _mm256_set1_epi32(0xF));
+    const __m256i index = _mm256_add_epi32(_mm256_slli_epi32(map, 12), _mm256_add_epi32(
+      _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(wy, 3), _mm256_set1_epi32(63)), 6),
+      _mm256_and_si256(_mm256_srli_epi32(wx, 3), _mm256_set1_epi32(63))
+    ));
+    const __m256i cell = _mm256_and_si256(
+      _mm256_mask_i32gather_epi32(overplane, dram, index, from_map, 2), _mm256_set1_epi32(0xFFFF)
+    );
+    const __m256i num = _mm256_and_si256(cell, _mm256_set1_epi32(0x7FF));
+
+    // any characters that haven't been decoded yet are done first.
+    const __m256i decoded = _mm256_and_si256(_mm256_i32gather_epi32(valid, num, 1), _mm256_set1_epi32(0xFF));
+
+    if (VB_UNLIKELY(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi32(decoded, zero), todo)))) {
+      int32_t nums[8];
+      _mm256_storeu_si256((__m256i*)nums, num);
+
+      for (uint8_t j = 0; j < 8; j++) {
+        if (!vb->vip_cache.char_valid[nums[j]]) {
+          vip_decode_character(vb, nums[j]);
+        }
+      }
+    }
+
+    // chars[num][hflip][vflip ? 7 - y : y][x]
+    const __m256i hflip = _mm256_and_si256(_mm256_srli_epi32(cell, 7), _mm256_set1_epi32(64));
+    const __m256i vflip = _mm256_and_si256(_mm256_srai_epi32(_mm256_slli_epi32(cell, 19), 31), _mm256_set1_epi32(7));
+    const __m256i row = _mm256_xor_si256(_mm256_and_si256(by, _mm256_set1_epi32(7)), vflip);
+    const __m256i offset = _mm256_add_epi32(
+      _mm256_add_epi32(_mm256_slli_epi32(num, 7), hflip),
+      _mm256_add_epi32(_mm256_slli_epi32(row, 3), _mm256_and_si256(bx, _mm256_set1_epi32(7)))
+    );
+    const __m256i pixel = _mm256_and_si256(_mm256_i32gather_epi32(chars, offset, 1), _mm256_set1_epi32(0xFF));
+
+    // palettes[cell >> 14] >> (pixel * 2)
+    const __m256i shift = _mm256_add_epi32(
+      _mm256_and_si256(_mm256_srli_epi32(cell, 11), _mm256_set1_epi32(0x18)), _mm256_slli_epi32(pixel, 1)
+    );
+    const __m256i colour = _mm256_and_si256(_mm256_srlv_epi32(palette, shift), _mm256_set1_epi32(0x3));
+    const __m256i draw = _mm256_andnot_si256(_mm256_cmpeq_epi32(pixel, zero), todo);
+
+    // down to bytes, the colours in the low 8 and what to draw in the high 8.
+    const __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(colour, draw), zero);
+    const __m128i result = _mm256_castsi256_si128(
+      _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7))
+    );
+
+    if (count - i >= 8) {
+      const __m128i old = _mm_loadl_epi64((const __m128i*)&out[i]);
+      _mm_storel_epi64((__m128i*)&out[i], vip_select_128(_mm_srli_si128(result, 8), result, old));
+    }
+    else {
+      uint8_t bytes[16];
+      _mm_storeu_si128((__m128i*)bytes, result);
+
+      for (int32_t j = 0; j < count - i; j++) {
+        if (bytes[8 + j]) {
+          out[i + j] = bytes[j];
+        }
+      }
+    }
+
+    vx = _mm256_add_epi32(vx, _mm256_set1_epi32(dx * 8));
+    vy = _mm256_add_epi32(vy, _mm256_set1_epi32(dy * 8));
+  }
+}
+#endif
+
+// draws count pixels of the background from (x, y), moving (dx, dy) each
+// pixel, all with 9 fractional bits.
+static void vip_draw_affine_row(
+  struct VB_Core* vb, const struct VipWorld* world, const uint8_t* palettes,
+  uint8_t* out, int32_t count, int32_t x, int32_t y, int32_t dx, int32_t dy
+) {
+  #if VB_VIP_AVX2
+    if (vb->vip_cache.avx2) {
+      vip_draw_affine_row_avx2(vb, world, palettes, out, count, x, y, dx, dy);
+      return;
+    }
+  #endif
+
+  for (int32_t i = 0; i < count; i++, x += dx, y += dy) {
+    const int32_t bx = x >> 9;
+    const int32_t by = y >> 9;
+    const uint16_t cell = vip_bg_cell(vb, world, bx, by);
+    const uint8_t* pixels = vip_character_row(vb, cell & 0x7FF, cell & 0x2000, cell & 0x1000, by & 7);
+
+    vip_draw_pixel(&out[i], pixels[bx & 7], palettes[cell >> 14]);
+  }
+}
+
+// normal worlds are drawn a character at a time, for both eyes in the one
+// pass. each eye sees the background moved by its parallax, so a cell is
+// at a different x in each eye, but it's the same cell.
+static void vip_draw_normal(struct VB_Core* vb, const struct VipWorld* world, const uint8_t* palettes, uint8_t eyes) {
+  int32_t lo[2] = {0}, hi[2] = {0}, offset[2] = {0};
+  // the part of the background that either eye shows.
+  int32_t first = INT32_MAX, last = INT32_MIN;
+
+  for (uint8_t eye = 0; eye < 2; eye++) {
+    if (!(eyes & (1 << eye))) {
+      continue;
+    }
+
+    const int32_t left = world->gx + (eye == VIP_EYE_LEFT ? -world->gp : world->gp);
+    const int32_t bg = world->mx + (eye == VIP_EYE_LEFT ? -world->mp : world->mp);
+
+    // clipped to the screen, a background x + offset is the screen x.
+    lo[eye] = VB_MAX(left, 0);
+    hi[eye] = VB_MIN(left + world->w + 1, VB_VIP_WIDTH);
+    offset[eye] = left - bg;
+
+    if (lo[eye] >= hi[eye]) {
+      eyes &= ~(1 << eye);
+      continue;
+    }
+
+    first = VB_MIN(first, lo[eye] - offset[eye]);
+    last = VB_MAX(last, hi[eye] - offset[eye]);
+  }
+
+  const int32_t y0 = VB_MAX(world->gy, 0);
+  const int32_t y1 = VB_MIN(world->gy + world->h + 1, VB_VIP_HEIGHT);
+
+  if (!eyes) {
+    return;
+  }
+
+  for (int32_t y = y0; y < y1; y++) {
+    const int32_t by = world->my + (y - world->gy);
+    uint8_t* out[2] = { vb->vip_cache.eyes[0][y], vb->vip_cache.eyes[1][y] };
+
+    for (int32_t bx = first & ~7; bx < last; bx += 8) {
+      bool inside[2];
+
+      for (uint8_t eye = 0; eye < 2; eye++) {
+        inside[eye] = (eyes & (1 << eye)) && bx + offset[eye] >= lo[eye] && bx + offset[eye] + 8 <= hi[eye];
+      }
+
+      const uint16_t cell = vip_bg_cell(vb, world, bx, by);
+      const uint8_t* pixels = vip_character_row(vb, cell & 0x7FF, cell & 0x2000, cell & 0x1000, by & 7);
+      const uint8_t palette = palettes[cell >> 14];
+
+      if (inside[0] && inside[1]) {
+        #if VB_VIP_SIMD >= 2
+          // and the next one too, if it's also fully on screen.
+          const int32_t next = bx + 8;
+
+          if (next + offset[0] + 8 <= hi[0] && next + offset[1] + 8 <= hi[1]) {
+            const uint16_t cell_b = vip_bg_cell(vb, world, next, by);
+            const uint8_t* pixels_b = vip_character_row(vb, cell_b & 0x7FF, cell_b & 0x2000, cell_b & 0x1000, by & 7);
+
+            vip_blend_16x2(out[0] + bx + offset[0], out[1] + bx + offset[1], pixels, palette, pixels_b, palettes[cell_b >> 14]);
+            bx = next;
+            continue;
+          }
+        #endif
+
+        vip_blend_8x2(out[0] + bx + offset[0], out[1] + bx + offset[1], pixels, palette);
+        continue;
+      }
+
+      for (uint8_t eye = 0; eye < 2; eye++) {
+        if (inside[eye]) {
+          vip_blend_8(out[eye] + bx + offset[eye], pixels, palette);
+        }
+        else if (eyes & (1 << eye)) {
+          // only part of it is on screen (or in the window).
+          for (int32_t i = 0; i < 8; i++) {
+            const int32_t x = bx + offset[eye] + i;
+
+            if (x >= lo[eye] && x < hi[eye]) {
+              vip_draw_pixel(&out[eye][x], pixels[i], palette);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+static void vip_draw_world(struct VB_Core* vb, const struct VipWorld* world, const uint8_t* palettes, enum VipEye eye) {
+  uint8_t (*out)[VB_VIP_WIDTH] = vb->vip_cache.eyes[eye];
+  const int32_t parallax = eye == VIP_EYE_LEFT ? -world->gp : world->gp;
+  const int32_t bg_parallax = eye == VIP_EYE_LEFT ? -world->mp : world->mp;
+
+  // clipped to the screen.
+  const int32_t left = world->gx + parallax;
+  const int32_t x0 = VB_MAX(left, 0);
+  const int32_t x1 = VB_MIN(left + world->w + 1, VB_VIP_WIDTH);
+  const int32_t y0 = VB_MAX(world->gy, 0);
+  const int32_t y1 = VB_MIN(world->gy + world->h + 1, VB_VIP_HEIGHT);
+
+  if (x0 >= x1) {
+    return;
+  }
+
+  for (int32_t y = y0; y < y1; y++) {
+    const int32_t row = y - world->gy;
+
+    switch ((enum VipWorldMode)world->mode) {
+      case VIP_WORLD_HBIAS: {
+        // a pair of offsets per row, left eye then right.
+        const int32_t offset = bit_sign_extend(12, vip_param(vb, world, row * 2 + eye));
+
+        vip_draw_bg_row(vb, world, palettes, &out[y][x0], x1 - x0,
+          world->mx + bg_parallax + offset + (x0 - left), world->my + row);
+      } break;
+
+      case VIP_WORLD_AFFINE: {
+        // 8 halfwords per row, mx and my are 13.3 fixed point, dx and dy
+        // are 7.9, everything is worked out in 9 fractional bits.
+        const int32_t mx = (int32_t)(int16_t)vip_param(vb, world, row * 8 + 0) * (1 << 6);
+        const int32_t mp = (int16_t)vip_param(vb, world, row * 8 + 1);
+        const int32_t my = (int32_t)(int16_t)vip_param(vb, world, row * 8 + 2) * (1 << 6);
+        const int32_t dx = (int16_t)vip_param(vb, world, row * 8 + 3);
+        const int32_t dy = (int16_t)vip_param(vb, world, row * 8 + 4);
+
+        // the parallax only moves the eye on its side, right if positive.
+        const int32_t shift = ((mp < 0) == (eye == VIP_EYE_LEFT)) ? (mp < 0 ? -mp : mp) : 0;
+
+        const int32_t start = x0 - left + shift;
+
+        vip_draw_affine_row(vb, world, palettes, &out[y][x0], x1 - x0,
+          mx + dx * start, my + dy * start, dx, dy);
+      } break;
+
+      case VIP_WORLD_NORMAL:
+      case VIP_WORLD_OBJ:
+        assert(!"drawn by vip_draw_normal() / vip_draw_objects()");
+        break;
+    }
+  }
+}
+
+// draws the rows of the object that are in the block starting at top.
+static void vip_draw_object(struct VB_Core* vb, const uint8_t* palettes, enum VipEye eye, uint16_t num, int32_t top) {
+  const uint16_t* attr = vb->vip.dram + OBJECT_ATTRIBUTES + num * 4;
+  uint8_t (*out)[VB_VIP_WIDTH] = vb->vip_cache.eyes[eye];
+
+  const int32_t jp = bit_sign_extend(9, attr[1]);
+  const int32_t x = bit_sign_extend(9, attr[0]) + (eye == VIP_EYE_LEFT ? -jp : jp);
+  const int32_t y = vip_object_y(attr);
+  const uint16_t cell = attr[3];
+  const uint8_t palette = palettes[cell >> 14];
+
+  for (int32_t row = VB_MAX(top - y, 0); row < 8 && y + row < top + 8; row++) {
+    const uint8_t* pixels = vip_character_row(vb, cell & 0x7FF, cell & 0x2000, cell & 0x1000, row);
+
+    if (x >= 0 && x + 8 <= VB_VIP_WIDTH) {
+      vip_blend_8(&out[y + row][x], pixels, palette);
+      continue;
+    }
+
+    for (int32_t col = VB_MAX(-x, 0); col < 8 && x + col < VB_VIP_WIDTH; col++) {
+      vip_draw_pixel(&out[y + row][x + col], pixels[col], palette);
+    }
+  }
+}
+
+// objects are drawn in 4 groups, the first obj world draws from SPT3 down
+// to SPT2 + 1, the next from SPT2 down to SPT1 + 1 and so on, the lower
+// numbered objects on top. each block is drawn from its bin, highest
+// numbered object first.
+static void vip_draw_objects(struct VB_Core* vb, const uint8_t* palettes, enum VipEye eye, uint8_t group) {
+  const uint16_t spt[4] = { vb->vip.SPT0, vb->vip.SPT1, vb->vip.SPT2, vb->vip.SPT3 };
+  const int32_t first = spt[group];
+  const int32_t last = group ? spt[group - 1] + 1 : 0;
+
+  for (int32_t block = 0; block < VB_VIP_HEIGHT / 8 && last <= first; block++) {
+    const uint64_t* bins = vb->vip_cache.obj_bins[eye][block];
+
+    for (int32_t word = first / 64; word >= last / 64; word--) {
+      uint64_t bits = bins[word];
+
+      // only the objects in the group.
+      if (word == first / 64) {
+        bits &= ~0ULL >> (63 - (first & 63));
+      }
+      if (word == last / 64) {
+        bits &= ~0ULL << (last & 63);
+      }
+
+      while (bits) {
+        const int32_t bit = VB_HIGHEST_BIT64(bits);
+        bits &= ~(1ULL << bit);
+        vip_draw_object(vb, palettes, eye, word * 64 + bit, block * 8);
+      }
+    }
+  }
+}
+
+// each column of the frame buffer is 256 pixels (224 are shown), 8 to a
+// halfword with the top pixel in the low bits.
+static void vip_write_frame_buffer(struct VB_Core* vb, enum VipEye eye) {
+  const uint8_t (*in)[VB_VIP_WIDTH] = (const uint8_t (*)[VB_VIP_WIDTH])vb->vip_cache.eyes[eye];
+  uint16_t* fb = vb->vip.vram + ((eye * 0x10000 + vb->vip.frame_buffer * 0x8000) >> 1);
+
+  for (uint32_t x = 0; x < VB_VIP_WIDTH; x++) {
+    for (uint32_t y = 0; y < VB_VIP_HEIGHT; y += 8) {
+      uint16_t value = 0;
+
+      for (uint32_t i = 0; i < 8; i++) {
+        value |= in[y + i][x] << (i * 2);
+      }
+
+      fb[x * 32 + y / 8] = value;
+    }
+  }
+}
+
+// draws the eyes (a bit for each VipEye) and packs them into the frame
+// buffers, the worlds are gone through once for both.
+static void vip_draw_eyes(struct VB_Core* vb, uint8_t eyes) {
+  const uint8_t gplt[4] = { vb->vip.GPLT0, vb->vip.GPLT1, vb->vip.GPLT2, vb->vip.GPLT3 };
+  const uint8_t jplt[4] = { vb->vip.JPLT0, vb->vip.JPLT1, vb->vip.JPLT2, vb->vip.JPLT3 };
+  int8_t group = 3;
+
+  for (uint8_t eye = 0; eye < 2; eye++) {
+    if (eyes & (1 << eye)) {
+      memset(vb->vip_cache.eyes[eye], vb->vip.BKCOL & 0x3, sizeof(vb->vip_cache.eyes[eye]));
+    }
+  }
+
+  for (int8_t num = VB_VIP_WORLDS - 1; num >= 0; num--) {
+    struct VipWorld world;
+    vip_get_world(vb, num, &world);
+
+    if (world.header & WORLD_END) {
+      break;
+    }
+
+    // the eyes that the world is drawn to.
+    const uint8_t on = eyes & (((world.header & WORLD_LON) ? 1 << VIP_EYE_LEFT : 0) | ((world.header & WORLD_RON) ? 1 << VIP_EYE_RIGHT : 0));
+
+    if (world.mode == VIP_WORLD_OBJ) {
+      // every obj world uses up a group, even if it isn't shown.
+      for (uint8_t eye = 0; eye < 2 && group >= 0; eye++) {
+        if (on & (1 << eye)) {
+          vip_draw_objects(vb, jplt, eye, group);
+        }
+      }
+      group--;
+    }
+    else if (world.mode == VIP_WORLD_NORMAL) {
+      vip_draw_normal(vb, &world, gplt, on);
+    }
+    else {
+      for (uint8_t eye = 0; eye < 2; eye++) {
+        if (on & (1 << eye)) {
+          vip_draw_world(vb, &world, gplt, eye);
+        }
+      }
+    }
+  }
+
+  for (uint8_t eye = 0; eye < 2; eye++) {
+    if (eyes & (1 << eye)) {
+      vip_write_frame_buffer(vb, eye);
+    }
+  }
+}
+
+// [Threads]
+// with vb_set_vip_threads(), the right eye is drawn on a worker thread
+// while the left eye is drawn on the cpu's thread. the cpu isn't running
+// while drawing, so both see vram, dram and the registers as they were
+// when drawing ended. drawing only reads those, and each eye writes to
+// only its own buffers. the one thing that is shared and written is the
+// character cache, so every character is decoded before the worker starts.
+#ifdef VB_THREADS
+struct VB_VipWorker {
+  struct VB_Core* vb;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint32_t started; // frames handed to the worker
+  uint32_t finished; // frames it has drawn
+  bool quit;
+};
+
+static void* vip_worker_thread(void* user) {
+  struct VB_VipWorker* worker = user;
+
+  pthread_mutex_lock(&worker->mutex);
+
+  for (;;) {
+    while (worker->started == worker->finished && !worker->quit) {
+      pthread_cond_wait(&worker->cond, &worker->mutex);
+    }
+
+    if (worker->quit) {
+      break;
+    }
+
+    pthread_mutex_unlock(&worker->mutex);
+    vip_draw_eyes(worker->vb, 1 << VIP_EYE_RIGHT);
+    pthread_mutex_lock(&worker->mutex);
+
+    worker->finished = worker->started;
+    pthread_cond_broadcast(&worker->cond);
+  }
+
+  pthread_mutex_unlock(&worker->mutex);
+  return NULL;
+}
+
+static bool vip_worker_start(struct VB_Core* vb) {
+  struct VB_VipWorker* worker = calloc(1, sizeof(*worker));
+
+  if (!worker) {
+    return false;
+  }
+
+  worker->vb = vb;
+
+  if (pthread_mutex_init(&worker->mutex, NULL)) {
+    free(worker);
+    return false;
+  }
+
+  if (pthread_cond_init(&worker->cond, NULL)) {
+    pthread_mutex_destroy(&worker->mutex);
+    free(worker);
+    return false;
+  }
+
+  if (pthread_create(&worker->thread, NULL, vip_worker_thread, worker)) {
+    pthread_cond_destroy(&worker->cond);
+    pthread_mutex_destroy(&worker->mutex);
+    free(worker);
+    return false;
+  }
+
+  vb->vip_worker = worker;
+  return true;
+}
+
+static void vip_worker_stop(struct VB_Core* vb) {
+  struct VB_VipWorker* worker = vb->vip_worker;
+
+  if (!worker) {
+    return;
+  }
+
+  pthread_mutex_lock(&worker->mutex);
+  worker->quit = true;
+  pthread_cond_broadcast(&worker->cond);
+  pthread_mutex_unlock(&worker->mutex);
+
+  pthread_join(worker->thread, NULL);
+  pthread_cond_destroy(&worker->cond);
+  pthread_mutex_destroy(&worker->mutex);
+  free(worker);
+
+  vb->vip_worker = NULL;
+}
+
+static void vip_draw_threaded(struct VB_Core* vb) {
+  struct VB_VipWorker* worker = vb->vip_worker;
+
+  for (uint16_t num = 0; num < VB_VIP_CHARS; num++) {
+    if (!vb->vip_cache.char_valid[num]) {
+      vip_decode_character(vb, num);
+    }
+  }
+
+  pthread_mutex_lock(&worker->mutex);
+  worker->started++;
+  pthread_cond_broadcast(&worker->cond);
+  pthread_mutex_unlock(&worker->mutex);
+
+  vip_draw_eyes(vb, 1 << VIP_EYE_LEFT);
+
+  // the frame isn't done until both eyes are.
+  pthread_mutex_lock(&worker->mutex);
+  while (worker->finished != worker->started) {
+    pthread_cond_wait(&worker->cond, &worker->mutex);
+  }
+  pthread_mutex_unlock(&worker->mutex);
+}
+#endif
+
+static void vip_draw(struct VB_Core* vb) {
+  if (!vb->vip_cache.obj_bins_valid) {
+    vip_bin_objects(vb);
+  }
+
+  #ifdef VB_THREADS
+    if (vb->vip_worker) {
+      vip_draw_threaded(vb);
+      return;
+    }
+  #endif
+
+  vip_draw_eyes(vb, (1 << VIP_EYE_LEFT) | (1 << VIP_EYE_RIGHT));
+}
+
+// the vip has one line to the cpu, raised while any enabled bit is pending.
+void vb_vip_update_irq(struct VB_Core* vb) {
+  vb_irq_set(vb, VB_Irq_VIP, vb->vip.INTPND & vb->vip.INTENB);
+}
 
+void vb_vip_schedule(struct VB_Core* vb) {
+  const uint64_t when = vb->vip.frame_start + VIP_FRAME_EVENT_CYCLES[vb->vip.frame_event];
+  vb_scheduler_add(vb, VB_Event_VIP, when);
+}
+
+void vb_vip_run(struct VB_Core* vb, uint64_t when) {
+  VB_UNUSED(when);
+
+  switch ((enum VipFrameEvent)vb->vip.frame_event) {
+    case VIP_FRAME_START:
+      vb->vip.INTPND |= VIP_INT_FRAMESTART;
+
+      // FRMCYC is how many extra display frames each game frame lasts.
+      if (vb->vip.game_frame >= vb->vip.FRMCYC) {
+        vb->vip.game_frame = 0;
+        vb->vip.INTPND |= VIP_INT_GAMESTART;
+
+        if (vb->vip.XPCTRL & VIP_XP_EN) {
+          vb->vip.drawing = true;
+          vb->vip.frame_buffer ^= 1;
+        }
+      }
+      else {
+        vb->vip.game_frame++;
+      }
+
+      vb->vip.frame_event = VIP_DRAW_END;
+      break;
+
+    case VIP_DRAW_END:
+      if (vb->vip.drawing) {
+        vip_draw(vb);
+        vb->vip.drawing = false;
+        vb->vip.INTPND |= VIP_INT_XPEND;
+      }
+
+      vb->vip.frame_event = VIP_LEFT_START;
+      break;
+
+    case VIP_LEFT_START:
+      vb->vip.frame_event = VIP_LEFT_END;
+      break;
+
+    case VIP_LEFT_END:
+      if (vb->vip.DPCTRL & VIP_DP_DISP) {
+        vb->vip.INTPND |= VIP_INT_LFBEND;
+      }
+
+      vb->vip.frame_event = VIP_FRAME_HALF;
+      break;
+
+    case VIP_FRAME_HALF:
+      vb->vip.frame_event = VIP_RIGHT_START;
+      break;
+
+    case VIP_RIGHT_START:
+      vb->vip.frame_event = VIP_RIGHT_END;
+      break;
+
+    case VIP_RIGHT_END:
+      if (vb->vip.DPCTRL & VIP_DP_DISP) {
+        vb->vip.INTPND |= VIP_INT_RFBEND;
+      }
+
+      vb->vip.frame_start += VB_CYCLES_PER_FRAME;
+      vb->vip.frame_event = VIP_FRAME_START;
+      break;
+  }
+
+  vb_vip_update_irq(vb);
+  vb_vip_schedule(vb);
 }
 
 void vb_vip_reset(struct VB_Core* vb) {
@@ -299,4 +1384,34 @@ void vb_vip_reset(struct VB_Core* vb) {
   for (size_t i = 0; i < VB_ARR_SIZE(vb->vip.dram); i++) {
     vb->vip.dram[i] = deadbeef[i & 3];
   }
+
+  memset(vb->vip_cache.char_valid, 0, sizeof(vb->vip_cache.char_valid));
+  vb->vip_cache.obj_bins_valid = false;
+
+  #if VB_VIP_AVX2
+    vb->vip_cache.avx2 = __builtin_cpu_supports("avx2");
+  #endif
+
+  vb->vip.frame_start = vb_now(vb);
+  vb->vip.frame_event = VIP_FRAME_START;
+  vb_vip_update_irq(vb);
+  vb_vip_schedule(vb);
+}
+
+void vb_set_vip_threads(struct VB_Core* vb, bool enable) {
+  #ifdef VB_THREADS
+    if (enable && !vb->vip_worker && !vip_worker_start(vb)) {
+      vb_log_err("[VIP] failed to start the draw thread, drawing on one\n");
+    }
+    else if (!enable) {
+      vip_worker_stop(vb);
+    }
+  #else
+    VB_UNUSED(vb);
+    VB_UNUSED(enable);
+  #endif
+}
+
+void vb_vip_quit(struct VB_Core* vb) {
+  vb_set_vip_threads(vb, false);
 }
@@ -45,6 +45,9 @@
 
 enum {
   SAMPLE_TICKS = VB_CPU_SPEED / VB_SAMPLE_RATE,
+
+  // SxINT intervals are in units of 3.84ms.
+  INTERVAL_CYCLES = VB_CPU_SPEED / 100000 * 384,
 };
 
 enum Channel {
@@ -104,6 +107,34 @@ static inline void vsu_modram_write(struct VB_Core* vb, uint8_t addr, uint8_t va
   }
 }
 
+// cycles until the channel moves onto its next sample.
+// the pcm channels are clocked at 5mhz, the noise channel at 500khz.
+static uint32_t vsu_step_cycles(struct VB_Core* vb, enum Channel channel) {
+  const uint32_t freq = (vb->vsu.channels[channel].SxFQH.high << 8) | vb->vsu.channels[channel].SxFQL.low;
+  return (2048 - freq) * (channel == Channel_6 ? 40 : 4);
+}
+
+// nothing outputs samples yet, but the position in waveram is still
+// brought up to date whenever something that changes it is written.
+static void vsu_channel_sync(struct VB_Core* vb, enum Channel channel, uint64_t now) {
+  if (!vsu_is_channel_enabled(vb, channel)) {
+    vb->vsu.channels[channel].step_start = now;
+    return;
+  }
+
+  if (now <= vb->vsu.channels[channel].step_start) {
+    return;
+  }
+
+  const uint32_t step = vsu_step_cycles(vb, channel);
+  const uint64_t steps = (now - vb->vsu.channels[channel].step_start) / step;
+  vb->vsu.channels[channel].step_start += steps * step;
+
+  if (channel != Channel_6) {
+    vb->vsu.channels[channel].sampling_position = (vb->vsu.channels[channel].sampling_position + steps) & 31;
+  }
+}
+
 static void vsu_sxint_write(struct VB_Core* vb, uint8_t value, enum Channel channel) {
   const uint8_t interval = bit_get_range(0, 4, value);
   const bool mode = bit_is_set(5, value);
@@ -124,6 +155,11 @@ static void vsu_sxint_write(struct VB_Core* vb, uint8_t value, enum Channel chan
 */
   vb->vsu.channels[channel].sampling_position = 0;
   // vb->vsu.channels[channel].sample =
+
+  const uint64_t now = vb_now(vb);
+  vb->vsu.channels[channel].step_start = now;
+  vb->vsu.channels[channel].stop_at = (enabled && mode) ? now + (interval + 1) * INTERVAL_CYCLES : 0;
+  vb_vsu_schedule(vb);
 }
 
 static void vsu_sxlrv_write(struct VB_Core* vb, uint8_t value, enum Channel channel) {
@@ -137,13 +173,17 @@ static void vsu_sxlrv_write(struct VB_Core* vb, uint8_t value, enum Channel chan
 static void vsu_sxfql_write(struct VB_Core* vb, uint8_t value, enum Channel channel) {
   const uint8_t low = value;
 
+  vsu_channel_sync(vb, channel, vb_now(vb));
   vb->vsu.channels[channel].SxFQL.low = low;
+  vb_vsu_schedule(vb);
 }
 
 static void vsu_sxfqh_write(struct VB_Core* vb, uint8_t value, enum Channel channel) {
   const uint8_t high = bit_get_range(0, 2, value);
 
+  vsu_channel_sync(vb, channel, vb_now(vb));
   vb->vsu.channels[channel].SxFQH.high = high;
+  vb_vsu_schedule(vb);
 }
 
 static void vsu_sxev0_write(struct VB_Core* vb, uint8_t value, enum Channel channel) {
@@ -182,7 +222,10 @@ static void vsu_sstop_write(struct VB_Core* vb, uint8_t value) {
 
     for (size_t i = 0; i < VB_ARR_SIZE(vb->vsu.channels); i++) {
       vb->vsu.channels[i].SxINT.enabled = false;
+      vb->vsu.channels[i].stop_at = 0;
     }
+
+    vb_vsu_schedule(vb);
   }
   else {
     printf("[VSU] sstop written to without stop-bit set...which is a nop\n");
@@ -267,6 +310,9 @@ void vsu_write_8(struct VB_Core* vb, uint32_t addr, uint8_t value) {
   #define VSU_ADDR(addr) (((addr) >> 7) & 0x1F)
   #define VSU_RAM_ADDR(addr) (((addr) >> 2) & 0x1F)
 
+  // a channel may have stopped since the vsu last ran.
+  vb_sync(vb, VB_Event_VSU);
+
   switch (VSU_ADDR(addr)) {
     case VSU_ADDR(0x0100007F): printf("[VSU] writing to waveform 1 ram: 0x%08X 0x%02X\n", addr, value); vsu_waveram_write(vb, VSU_RAM_ADDR(addr), value, 0); break;
     case VSU_ADDR(0x010000FF): printf("[VSU] writing to waveform 2 ram: 0x%08X 0x%02X\n", addr, value); vsu_waveram_write(vb, VSU_RAM_ADDR(addr), value, 1); break;
@@ -295,10 +341,38 @@ void vsu_write_16(struct VB_Core* vb, uint32_t addr, uint16_t value) {
 
 // }
 
-void vb_vsu_run(struct VB_Core* vb, uint8_t cycles) {
+// the only thing the vsu has to be woken for (for now) is a channel
+// reaching the end of its interval, so it asks for the earliest one.
+void vb_vsu_schedule(struct VB_Core* vb) {
+  uint64_t when = UINT64_MAX;
+
+  for (size_t i = 0; i < VB_ARR_SIZE(vb->vsu.channels); i++) {
+    if (vb->vsu.channels[i].SxINT.enabled && vb->vsu.channels[i].stop_at) {
+      when = VB_MIN(when, vb->vsu.channels[i].stop_at);
+    }
+  }
+
+  if (when == UINT64_MAX) {
+    vb_scheduler_remove(vb, VB_Event_VSU);
+  }
+  else {
+    vb_scheduler_add(vb, VB_Event_VSU, when);
+  }
+}
+
+void vb_vsu_run(struct VB_Core* vb, uint64_t when) {
+  for (size_t i = 0; i < VB_ARR_SIZE(vb->vsu.channels); i++) {
+    if (vb->vsu.channels[i].SxINT.enabled && vb->vsu.channels[i].stop_at && vb->vsu.channels[i].stop_at <= when) {
+      vsu_channel_sync(vb, i, vb->vsu.channels[i].stop_at);
+      vb->vsu.channels[i].SxINT.enabled = false;
+      vb->vsu.channels[i].stop_at = 0;
+    }
+  }
 
+  vb_vsu_schedule(vb);
 }
 
 void vb_vsu_reset(struct VB_Core* vb) {
   memset(&vb->vsu, 0, sizeof(vb->vsu));
+  vb_scheduler_remove(vb, VB_Event_VSU);
 }
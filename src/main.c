@@ -3,6 +3,9 @@
  * SPDX-License-Identifier: MIT
  */
 
+// needed for mmap / open
+#define _DEFAULT_SOURCE
+
 #include "core/vb.h"
 #include "core/internal.h"
 
@@ -38,6 +41,59 @@ static bool read_file(const char* path, uint8_t* out_buf, size_t* out_size) {
   return true;
 }
 
+// the block cache for the rom lives in the dir as <rom hash>.vbc
+static void get_cache_path(const char* dir, char* out, size_t size) {
+  snprintf(out, size, "%s/%016llx.vbc", dir, (unsigned long long)vb_get_rom_hash(&CORE));
+}
+
+static bool load_cache(const char* dir) {
+  char path[4096];
+  get_cache_path(dir, path, sizeof(path));
+
+  // there can't be more rom blocks than entries in the block cache.
+  static uint32_t buf[sizeof(struct VB_CacheHeader) / 4 + VB_BLOCK_ENTRIES];
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+
+  const size_t size = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+  const bool result = vb_loadcache(&CORE, buf, size);
+
+  if (!result) {
+    printf("ignoring cache: %s\n", path);
+  }
+
+  return result;
+}
+
+static void save_cache(const char* dir) {
+  char path[4096];
+  get_cache_path(dir, path, sizeof(path));
+
+  const size_t size = vb_get_cache_size(&CORE);
+  void* data = malloc(size);
+
+  if (data && vb_savecache(&CORE, data, size)) {
+    // written to the side then renamed, so another run never reads half of it.
+    char temp[4096 + 8];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+    FILE* f = fopen(temp, "wb");
+    if (f) {
+      const bool ok = fwrite(data, 1, size, f) == size;
+      fclose(f);
+
+      if (!ok || rename(temp, path)) {
+        remove(temp);
+      }
+    }
+  }
+
+  free(data);
+}
+
 int main(int argc, char** argv) {
   if (argc < 2) {
     printf("missing args\n");
@@ -58,6 +114,10 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  // optional dir to keep the block cache in.
+  const char* cache_dir = argc > 2 ? argv[2] : NULL;
+  const bool cache_loaded = cache_dir && load_cache(cache_dir);
+
   #define HZ (1000000)
   #define CYCLES_PER_FRAME ((20 * HZ) / 60) / 4
   #define STEP_COUNT CYCLES_PER_FRAME
@@ -72,10 +132,18 @@ int main(int argc, char** argv) {
   for (int frame_count = 0; ;frame_count++)
   {
     vb_step(&CORE);
+
+    // by now most of the code the rom runs has been built.
+    if (frame_count == 600 && cache_dir && !cache_loaded) {
+      save_cache(cache_dir);
+    }
+
     if ((frame_count % 60) == 0) {
       printf("\nframe count: %d\n\n", frame_count);
     }
   }
 
+  vb_quit(&CORE);
+
   return 0;
 }